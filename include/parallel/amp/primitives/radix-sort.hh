@@ -2,12 +2,46 @@
 
 #include <amp.h>
 
+#include <memory>
+
 namespace parallel {
 namespace amp {
 
+// Sorts with scratch kept between calls. The scratch grows by at least half
+// of its capacity when a sort needs more, and is only released by trim().
+// attach() makes the sorter use a caller owned scratch of scratch_size()
+// elements instead, which is never reallocated.
+// With is_64bit every key is a pair of uint32_t words, the low word first,
+// key holds 2 * count words and index count elements. is_signed then sorts
+// int64_t keys and is_float double keys.
+// Every element of index is a value of value_words words, up to 8, which is
+// moved along with its key.
+struct radix_sorter {
+  size_t capacity = 0;
+  bool attached = false;
+
+  static size_t scratch_size(size_t count, bool with_index = true, uint32_t bits_per_pass = 8,
+    bool is_64bit = false, uint32_t value_words = 1);
+  void reserve(concurrency::accelerator_view & av, size_t count, bool with_index = true,
+    uint32_t bits_per_pass = 8, bool is_64bit = false, uint32_t value_words = 1);
+  void attach(concurrency::array_view<uint32_t> scratch);
+  void trim();
+
+  void sort(concurrency::accelerator_view & av,
+    concurrency::array_view<uint32_t> key, concurrency::array_view<uint32_t> index,
+    bool descending = false, bool is_signed = false, bool is_float = false,
+    uint32_t bits_per_pass = 8, bool is_64bit = false, uint32_t value_words = 1);
+private:
+  void grow(concurrency::accelerator_view & av, size_t size);
+
+  std::unique_ptr<concurrency::array<uint32_t>> storage;
+  std::unique_ptr<concurrency::array_view<uint32_t>> scratch;
+};
+
 void radix_sort(concurrency::accelerator_view & av,
   concurrency::array_view<uint32_t> key, concurrency::array_view<uint32_t> index,
-  bool descending = false, bool is_signed = false, bool is_float = false);
+  bool descending = false, bool is_signed = false, bool is_float = false,
+  uint32_t bits_per_pass = 8, bool is_64bit = false, uint32_t value_words = 1);
 
 }
 }
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <parallel/cpu/thread-pool.hh>
+
+#include <cstdint>
+
+namespace parallel {
+namespace cpu {
+
+void radix_sort(thread_pool & pool, uint32_t * key, size_t size, uint32_t * index = nullptr,
+  bool descending = false, bool is_signed = false, bool is_float = false);
+
+// Sorts from the top digit down with no second key or index array, only
+// blocks of 256 keys per bucket and thread. Keys that compare equal may end
+// up with their values in any order.
+void radix_sort_in_place(thread_pool & pool, uint32_t * key, size_t size, uint32_t * index = nullptr,
+  bool descending = false, bool is_signed = false, bool is_float = false);
+
+}
+}
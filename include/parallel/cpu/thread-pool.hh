@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+namespace cpu {
+
+struct thread_pool {
+  explicit thread_pool(size_t threads = std::thread::hardware_concurrency());
+  ~thread_pool();
+  thread_pool(thread_pool const &) = delete;
+  thread_pool & operator=(thread_pool const &) = delete;
+
+  // Calls f(i) for every i in [0, count) on the workers and the calling
+  // thread, returns when all calls are done. Calls from several threads take
+  // the pool one after another. Not reentrant, a call from f deadlocks.
+  void run(size_t count, std::function<void(size_t)> const & f);
+  size_t size() const { return workers.size() + 1; }
+
+  static thread_pool & instance();
+private:
+  void work();
+  void drain();
+
+  std::vector<std::thread> workers;
+  std::mutex running; // held by run() for its whole job
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  std::function<void(size_t)> const * job = nullptr;
+  size_t job_count = 0;
+  std::atomic<size_t> next { 0 };
+  size_t pending = 0;
+  size_t generation = 0;
+  bool stop = false;
+};
+
+}
+}
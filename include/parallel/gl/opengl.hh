@@ -1,12 +1,40 @@
 #pragma once
 
+#if defined(_WIN32)
 #define WIN32_LEAN_AND_MEAN 1
 #define WIN32_EXTRA_LEAN
 #include <windows.h>
+#pragma comment(lib, "opengl32.lib")
+#endif
+
+// Headless EGL context (surfaceless or EGL device platform) instead of WGL.
+// Always used outside of Windows, opt-in on Windows.
+#if !defined(_WIN32) && !defined(PARALLEL_GL_EGL)
+#define PARALLEL_GL_EGL 1
+#endif
+
+#if defined(PARALLEL_GL_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 #include <GL/gl.h>
 #include <GL/glext.h>
 
-#pragma comment(lib, "opengl32.lib")
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef GL_ARB_gl_spirv
+#define GL_SHADER_BINARY_FORMAT_SPIR_V_ARB 0x9551
+typedef void (APIENTRYP PFNGLSPECIALIZESHADERARBPROC) (GLuint shader, const GLchar * pEntryPoint,
+  GLuint numSpecializationConstants, const GLuint * pConstantIndex, const GLuint * pConstantValue);
+#endif
+
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(a) (sizeof(a) / sizeof(*(a)))
+#endif
 
 #define EACH(i, size) for (GLsizeiptr i = 0; i < size; i++)
 
@@ -19,76 +47,199 @@
 #define GLSL_DEFINE(name, ...) "#define " STR(name) " " GLSL(__VA_ARGS__)
 
 #define GL_FUNCTIONS(FUNCTION)                         \
+  FUNCTION(AttachShader,         ATTACHSHADER)         \
   FUNCTION(BindBuffer,           BINDBUFFER)           \
   FUNCTION(BindBufferBase,       BINDBUFFERBASE)       \
   FUNCTION(BindBufferRange,      BINDBUFFERRANGE)      \
   FUNCTION(BindProgramPipeline,  BINDPROGRAMPIPELINE)  \
+  FUNCTION(ClientWaitSync,       CLIENTWAITSYNC)       \
   FUNCTION(GetBufferParameteriv, GETBUFFERPARAMETERIV) \
   FUNCTION(GetBufferParameteri64v, GETBUFFERPARAMETERI64V) \
   FUNCTION(BufferData,           BUFFERDATA)           \
   FUNCTION(BufferSubData,        BUFFERSUBDATA)        \
+  FUNCTION(ClearBufferSubData,   CLEARBUFFERSUBDATA)   \
   FUNCTION(CopyBufferSubData,    COPYBUFFERSUBDATA)    \
+  FUNCTION(CompileShader,        COMPILESHADER)        \
+  FUNCTION(CreateProgram,        CREATEPROGRAM)        \
+  FUNCTION(CreateShader,         CREATESHADER)         \
   FUNCTION(CreateShaderProgramv, CREATESHADERPROGRAMV) \
   FUNCTION(DebugMessageCallback, DEBUGMESSAGECALLBACK) \
   FUNCTION(DebugMessageInsert,   DEBUGMESSAGEINSERT)   \
+  FUNCTION(DeleteBuffers,        DELETEBUFFERS)        \
+  FUNCTION(DeleteProgram,        DELETEPROGRAM)        \
+  FUNCTION(DeleteShader,         DELETESHADER)         \
+  FUNCTION(DeleteSync,           DELETESYNC)           \
+  FUNCTION(DetachShader,         DETACHSHADER)         \
   FUNCTION(DispatchCompute,      DISPATCHCOMPUTE)      \
+  FUNCTION(DispatchComputeIndirect, DISPATCHCOMPUTEINDIRECT) \
+  FUNCTION(FenceSync,            FENCESYNC)            \
   FUNCTION(GenBuffers,           GENBUFFERS)           \
   FUNCTION(GenProgramPipelines,  GENPROGRAMPIPELINES)  \
+  FUNCTION(GetProgramBinary,     GETPROGRAMBINARY)     \
   FUNCTION(GetProgramInfoLog,    GETPROGRAMINFOLOG)    \
   FUNCTION(GetProgramiv,         GETPROGRAMIV)         \
+  FUNCTION(GetShaderiv,          GETSHADERIV)          \
+  FUNCTION(GetShaderInfoLog,     GETSHADERINFOLOG)     \
+  FUNCTION(GetStringi,           GETSTRINGI)           \
+  FUNCTION(LinkProgram,          LINKPROGRAM)          \
   FUNCTION(MapBuffer,            MAPBUFFER)            \
   FUNCTION(MapBufferRange,       MAPBUFFERRANGE)       \
   FUNCTION(MemoryBarrier,        MEMORYBARRIER)        \
+  FUNCTION(ProgramBinary,        PROGRAMBINARY)        \
+  FUNCTION(ProgramParameteri,    PROGRAMPARAMETERI)    \
+  FUNCTION(ShaderBinary,         SHADERBINARY)         \
+  FUNCTION(ShaderSource,         SHADERSOURCE)         \
   FUNCTION(UnmapBuffer,          UNMAPBUFFER)          \
   FUNCTION(UseProgram,           USEPROGRAM)           \
-  FUNCTION(UseProgramStages,     USEPROGRAMSTAGES)
+  FUNCTION(UseProgramStages,     USEPROGRAMSTAGES)     \
+  FUNCTION(WaitSync,             WAITSYNC)
+
+// ARB_direct_state_access entry points of the buffer wrapper, which binds the
+// buffer to a target for every call without them.
+#define GL_DSA_FUNCTIONS(FUNCTION)                                       \
+  FUNCTION(ClearNamedBufferSubData,     CLEARNAMEDBUFFERSUBDATA)         \
+  FUNCTION(CopyNamedBufferSubData,      COPYNAMEDBUFFERSUBDATA)          \
+  FUNCTION(CreateBuffers,               CREATEBUFFERS)                   \
+  FUNCTION(GetNamedBufferParameteri64v, GETNAMEDBUFFERPARAMETERI64V)     \
+  FUNCTION(MapNamedBufferRange,         MAPNAMEDBUFFERRANGE)             \
+  FUNCTION(NamedBufferData,             NAMEDBUFFERDATA)                 \
+  FUNCTION(NamedBufferSubData,          NAMEDBUFFERSUBDATA)              \
+  FUNCTION(UnmapNamedBuffer,            UNMAPNAMEDBUFFER)
 
 namespace parallel {
 namespace gl {
 
 struct GL {
 #define FUNCTION(name, NAME) \
-PFNGL ## NAME ## PROC name;
+PFNGL ## NAME ## PROC name = nullptr;
   GL_FUNCTIONS(FUNCTION)
+  GL_DSA_FUNCTIONS(FUNCTION) // null without ARB_direct_state_access
 #undef FUNCTION
-  GLint alignment;
-  GL & initialize(HDC device, GLDEBUGPROC debug_message_callback, bool debug = false);
+  GLint alignment = 0;
+  GLint storage_alignment = 0;
+  bool subgroup_arithmetic = false; // KHR_shader_subgroup arithmetic in compute shaders
+  char const * program_cache = nullptr; // directory of linked program binaries, none when null
+  bool parallel_compile = false; // KHR or ARB_parallel_shader_compile, programs link in the background
+  PFNGLSPECIALIZESHADERARBPROC SpecializeShader = nullptr; // ARB_gl_spirv, null without it
+  // Directory of pre-built SPIR-V modules, each loaded when present instead of
+  // compiling the GLSL it was built from. The parallel-gl-modules tool builds
+  // the ones of the kernels there. Ignored without ARB_gl_spirv.
+  char const * spirv_modules = nullptr;
+  // Context created by initialize() and current on the thread that called it.
+  // With share it joins the share group of the context of share, so buffers
+  // and programs of one are usable in the other, which lets every thread
+  // drive a context of its own.
+#if defined(PARALLEL_GL_EGL)
+  EGLContext context = EGL_NO_CONTEXT;
+  EGLSurface surface = EGL_NO_SURFACE; // pbuffer of a context with a config, see initialize()
+  GL & initialize(GLDEBUGPROC debug_message_callback, bool debug = false, GL const * share = nullptr);
+#else
+  HGLRC context = nullptr;
+  GL & initialize(HDC device, GLDEBUGPROC debug_message_callback, bool debug = false, GL const * share = nullptr);
+#endif
   void deinitialize();
 
+  // Bindings made by program and buffer in this context, each call of which
+  // that would change none of them is skipped. Code binding programs, indexed
+  // uniform or storage buffers or the dispatch indirect buffer on its own calls
+  // forget_bindings() before it uses them again. A deleted buffer is unbound.
+  struct binding { GLuint id; GLintptr offset; GLsizeiptr size; };
+  mutable struct {
+    GLuint program, dispatch_indirect;
+    binding uniform[4], storage[16];
+  } bound = {};
+  void forget_bindings() const {
+    bound.program = bound.dispatch_indirect = ~0u;
+    for (auto & binding : bound.uniform) binding.size = -2;
+    for (auto & binding : bound.storage) binding.size = -2;
+  }
+  void forget_buffer(GLuint id) const {
+    if (bound.dispatch_indirect == id) bound.dispatch_indirect = ~0u;
+    for (auto & binding : bound.uniform) if (binding.id == id) binding.size = -2;
+    for (auto & binding : bound.storage) if (binding.id == id) binding.size = -2;
+  }
+  void use_program(GLuint id) const {
+    if (bound.program != id) UseProgram(bound.program = id);
+  }
+  void bind_dispatch_indirect(GLuint id) const {
+    if (bound.dispatch_indirect != id) BindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bound.dispatch_indirect = id);
+  }
+  // size -1 binds the whole buffer
+  void bind_buffer(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size) const {
+    auto bindings = target == GL_UNIFORM_BUFFER ? bound.uniform
+      : target == GL_SHADER_STORAGE_BUFFER ? bound.storage : nullptr;
+    auto count = target == GL_UNIFORM_BUFFER ? ARRAYSIZE(bound.uniform) : ARRAYSIZE(bound.storage);
+    if (bindings != nullptr && index < count) {
+      auto & binding = bindings[index];
+      if (binding.id == id && binding.offset == offset && binding.size == size) return;
+      binding = { id, offset, size };
+    }
+    if (size < 0) BindBufferBase(target, index, id);
+    else BindBufferRange(target, index, id, offset, size);
+  }
+
   static GL & instance();
 };
 
 struct buffer
 {
   GLuint id;
+  // Size of the buffer as last allocated through this copy or queried by
+  // size(), -1 until then. A copy made before another one reallocates the
+  // buffer keeps the size it knew.
+  GLsizeiptr known_size = -1;
+  // A name of glGenBuffers, which a wrapped id may be, is no buffer object
+  // before it is first bound, so direct state access binds one of unknown size.
   template<GLenum USAGE>
-  void allocate(GL const & gl, GLsizeiptr size) {
-    gl.BindBuffer(GL_COPY_WRITE_BUFFER, id);
-    gl.BufferData(GL_COPY_WRITE_BUFFER, size, nullptr, USAGE);
+  void allocate(GL const & gl, GLsizeiptr size, void const * data = nullptr) {
+    if (gl.NamedBufferData != nullptr) {
+      if (known_size < 0) gl.BindBuffer(GL_COPY_WRITE_BUFFER, id);
+      gl.NamedBufferData(id, size, data, USAGE);
+    } else {
+      gl.BindBuffer(GL_COPY_WRITE_BUFFER, id);
+      gl.BufferData(GL_COPY_WRITE_BUFFER, size, data, USAGE);
+    }
+    known_size = size;
   }
   template<GLenum USAGE>
   GLsizeiptr allocate(GL const & gl, GLsizeiptr size, GLsizei count, bool aligned = false) {
     auto aligned_size = aligned
       ? ((size + gl.alignment - 1) / gl.alignment) * gl.alignment
       : size * count;
-    gl.BindBuffer(GL_COPY_WRITE_BUFFER, id);
-    gl.BufferData(GL_COPY_WRITE_BUFFER, aligned_size * count, nullptr, USAGE);
+    allocate<USAGE>(gl, aligned_size * count);
     return aligned_size;
   }
   void free(GL const & gl) {
+    allocate<GL_DYNAMIC_COPY>(gl, 0);
+  }
+  void clear(GL const & gl, GLintptr offset, GLsizeiptr size) {
+    if (gl.ClearNamedBufferSubData != nullptr)
+      return gl.ClearNamedBufferSubData(id, GL_R32UI, offset, size, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    gl.BindBuffer(GL_COPY_WRITE_BUFFER, id);
+    gl.ClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, offset, size, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  }
+  void sub_data(GL const & gl, void const * data, GLsizeiptr size, GLintptr offset) {
+    if (gl.NamedBufferSubData != nullptr) return gl.NamedBufferSubData(id, offset, size, data);
     gl.BindBuffer(GL_COPY_WRITE_BUFFER, id);
-    gl.BufferData(GL_COPY_WRITE_BUFFER, 0, nullptr, GL_DYNAMIC_COPY);
+    gl.BufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
   }
   template<typename T>
   void sub_data(GL const & gl, T && data, GLsizeiptr offset) {
-    gl.BindBuffer(GL_COPY_WRITE_BUFFER, id);
-    gl.BufferSubData(GL_COPY_WRITE_BUFFER, offset, sizeof(T), &data);
+    sub_data(gl, &data, sizeof(T), offset);
   }
+  // A packed array is written by a single call.
   template<typename T, size_t N>
   void sub_data(GL const & gl, T (&array)[N], GLsizeiptr alignment) {
+    if (alignment == sizeof(T)) return sub_data(gl, array, sizeof(array), 0);
+    EACH (i, GLsizeiptr(N))
+      sub_data(gl, &array[i], sizeof(T), i * alignment);
+  }
+  void copy(GL const & gl, buffer source, GLintptr source_offset, GLintptr offset, GLsizeiptr size) {
+    if (gl.CopyNamedBufferSubData != nullptr)
+      return gl.CopyNamedBufferSubData(source.id, id, source_offset, offset, size);
+    gl.BindBuffer(GL_COPY_READ_BUFFER, source.id);
     gl.BindBuffer(GL_COPY_WRITE_BUFFER, id);
-    EACH (i, N)
-      gl.BufferSubData(GL_COPY_WRITE_BUFFER, i * alignment, sizeof(T), &array[i]);
+    gl.CopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source_offset, offset, size);
   }
   template<GLenum TARGET, GLenum ACCESS, typename T, typename F>
   void map(GL const & gl, F && f) {
@@ -100,75 +251,211 @@ struct buffer
   }
   template<GLenum TARGET, GLenum ACCESS, typename T, typename F>
   void map(GL const & gl, GLsizeiptr offset, GLsizeiptr count, F && f) {
+    if (gl.MapNamedBufferRange != nullptr) {
+      f(gl, reinterpret_cast<T *>(gl.MapNamedBufferRange(id, offset * sizeof(T), count * sizeof(T), ACCESS)), count);
+      gl.UnmapNamedBuffer(id);
+      return;
+    }
     gl.BindBuffer(TARGET, id);
     auto ptr = reinterpret_cast<T *>(gl.MapBufferRange(TARGET, offset * sizeof(T), count * sizeof(T), ACCESS));
     f(gl, ptr, count);
     gl.UnmapBuffer(TARGET);
   }
   template<GLenum TARGET>
-  void bind(GL const & gl, GLuint index) { gl.BindBufferBase(TARGET, index, id); }
+  void bind(GL const & gl, GLuint index) { gl.bind_buffer(TARGET, index, id, 0, -1); }
   template<GLenum TARGET>
   void bind(GL const & gl, GLuint index, GLsizeiptr offset, GLsizeiptr size) {
-    gl.BindBufferRange(TARGET, index, id, offset, size);
+    gl.bind_buffer(TARGET, index, id, offset, size);
   }
   GLsizeiptr size(GL const & gl) {
-    if (sizeof(GLsizeiptr) == sizeof(GLint)) {
-      GLint size = 0;
+    if (known_size >= 0) return known_size;
+    GLint64 size = 0;
+    if (gl.GetNamedBufferParameteri64v != nullptr) {
+      gl.GetNamedBufferParameteri64v(id, GL_BUFFER_SIZE, &size);
+    } else if (sizeof(GLsizeiptr) == sizeof(GLint)) {
+      GLint size32 = 0;
       gl.BindBuffer(GL_COPY_READ_BUFFER, id);
-      gl.GetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
-      return (GLsizeiptr)size;
+      gl.GetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size32);
+      size = size32;
     } else {
-      GLint64 size = 0;
       gl.BindBuffer(GL_COPY_READ_BUFFER, id);
       gl.GetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
-      return (GLsizeiptr)size;
     }
+    return known_size = (GLsizeiptr)size;
   }
   bool is_empty() { return id == 0; }
   static buffer empty() {
     return buffer{ 0 };
   }
+  // Named buffers only exist once bound, created ones are usable by the
+  // direct state access entry points right away.
   static void factory(GL const & gl, GLsizei count, buffer * buffers) {
-    gl.GenBuffers(count, reinterpret_cast<GLuint *>(buffers));
+    EACH(i, count) {
+      buffers[i] = empty();
+      if (gl.CreateBuffers == nullptr) {
+        gl.GenBuffers(1, &buffers[i].id);
+        continue;
+      }
+      gl.CreateBuffers(1, &buffers[i].id);
+      buffers[i].known_size = 0;
+    }
+  }
+  static void destroy(GL const & gl, GLsizei count, buffer * buffers) {
+    EACH(i, count) {
+      gl.forget_buffer(buffers[i].id);
+      gl.DeleteBuffers(1, &buffers[i].id);
+      buffers[i] = empty();
+    }
   }
 };
 
+// Completion of the commands queued before insert(). ready() polls without
+// blocking and wait() blocks up to timeout nanoseconds, the first of them to
+// see the fence signaled deletes its sync object and runs the callback set
+// by then(), so an event loop polling ready() gets the callback on its
+// thread. A fence has a single owner, release() drops it unsignaled.
+// A wait that fails is reported as a debug error and releases the fence,
+// wait() returns false for it with the callback dropped.
+struct fence {
+  GLsync sync;
+  std::function<void()> callback;
+
+  bool ready(GL const & gl) { return wait(gl, 0); }
+  bool wait(GL const & gl, GLuint64 timeout = GL_TIMEOUT_IGNORED) {
+    if (sync == nullptr) return true;
+    auto status = gl.ClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (status == GL_WAIT_FAILED) {
+      gl.DebugMessageInsert(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_ERROR,
+        GL_WAIT_FAILED, GL_DEBUG_SEVERITY_HIGH, -1, "glClientWaitSync failed, fence released");
+      release(gl);
+      return false;
+    }
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+    gl.DeleteSync(sync);
+    sync = nullptr;
+    if (callback) std::exchange(callback, nullptr)();
+    return true;
+  }
+  fence & then(std::function<void()> f) {
+    callback = std::move(f);
+    return *this;
+  }
+  void release(GL const & gl) {
+    gl.DeleteSync(sync);
+    sync = nullptr;
+    callback = nullptr;
+  }
+  static fence insert(GL const & gl) {
+    auto sync = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); // a fence never signals while it is only queued
+    return fence{ sync, nullptr };
+  }
+};
+
+// Reports a program that failed to link with its info log, or with the
+// compile log of its shader, which waits for a program still linking in the
+// background. The first check of a program of create_program() also stores
+// its binary in gl.program_cache.
+void check_program(GL const & gl, GLuint id);
+
 template<GLuint TYPE>
 struct program  {
   GLuint id;
+  bool checked;
 };
 
+// With parallel_compile the link status is checked on the first dispatch, so
+// only the programs in use are waited for.
 template<>
 struct program<GL_COMPUTE_SHADER> {
   GLuint id;
+  bool checked;
   void dispatch(GL const & gl, GLuint x = 1, GLuint y = 1, GLuint z = 1) {
-    gl.UseProgram(id);
+    use(gl);
     gl.DispatchCompute(x, y, z);
   }
+  void dispatch(GL const & gl, buffer const & arguments, GLintptr offset) {
+    use(gl);
+    gl.bind_dispatch_indirect(arguments.id);
+    gl.DispatchComputeIndirect(offset);
+  }
+private:
+  void use(GL const & gl) {
+    if (!checked) check_program(gl, id);
+    checked = true;
+    gl.use_program(id);
+  }
 };
 
-template<GLuint TYPE, typename... Sources>
-program<TYPE>
-make_program(GL const & gl, Sources... sources) {
-  GLchar const * array_sources[] = {
-    "#version 430 core\n"
+// Values of the CONSTANT(id, type, name, value) declarations of a program,
+// see make_program().
+struct specialization {
+  GLuint count;
+  GLuint const * ids;
+  GLuint const * values;
+};
+
+// Compiles and links a separable program of sources, the first of them its
+// #version line, without waiting for either, see check_program(). With gl.program_cache the linked binary is stored there,
+// named by a hash of the driver strings, of the sources and of constants, and
+// later programs of the same are loaded from it unless the driver rejects the
+// binary. With gl.spirv_modules the sources are compiled from their pre-built
+// SPIR-V module when there is one, specialized by glSpecializeShader on
+// constants, and the GLSL gets them as CONSTANT_<id> defines otherwise.
+GLuint create_program(GL const & gl, GLenum type, GLsizei count, GLchar const * const * sources,
+  specialization const & constants = specialization { 0, nullptr, nullptr });
+
+// Path of the SPIR-V module create_program() looks for in directory.
+std::string module_path(char const * directory, GLenum type, GLsizei count, GLchar const * const * sources);
+
+// Path of the program binary create_program() stores in gl.program_cache.
+std::string binary_path(GL const & gl, GLenum type, GLsizei count, GLchar const * const * sources,
+  specialization const & constants = specialization { 0, nullptr, nullptr });
+
+// The sources make_program() compiles for sources, on a device with or
+// without KHR_shader_subgroup arithmetic. CONSTANT(id, type, name, value)
+// declares a specialization constant of the SPIR-V module built from them
+// and a constant of the CONSTANT_<id> define of the GLSL.
+inline std::vector<GLchar const *>
+program_sources(bool subgroup_arithmetic, GLsizei count, GLchar const * const * sources) {
+  std::vector<GLchar const *> program_sources = {
+    "#version 430 core\n",
+    subgroup_arithmetic
+      ? "#extension GL_KHR_shader_subgroup_basic : enable\n"
+        "#extension GL_KHR_shader_subgroup_arithmetic : enable\n"
+        "#define SUBGROUP_ARITHMETIC 1\n"
+      : "#define SUBGROUP_ARITHMETIC 0\n",
+    "#ifdef GL_SPIRV\n"
+    "#define CONSTANT(id, type, name, value) layout(constant_id = id) const type name = value;\n"
+    "#else\n"
+    "#define CONSTANT(id, type, name, value) const type name = type(CONSTANT_##id);\n"
+    "#endif\n",
     GLSL(
     precision highp float;
     precision highp int;
     layout(std140, column_major) uniform;
     layout(std430, column_major) buffer;
-    ), sources...
+    )
   };
-  auto id = gl.CreateShaderProgramv(TYPE, ARRAYSIZE(array_sources), array_sources);
-  auto status = GL_TRUE;
-  gl.GetProgramiv(id, GL_LINK_STATUS, &status);
-  if (GL_TRUE != status) {
-    char info[1024];
-    gl.GetProgramInfoLog(id, sizeof(info), nullptr, info);
-    gl.DebugMessageInsert(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_ERROR,
-      GL_LINK_STATUS, GL_DEBUG_SEVERITY_HIGH, -1, info);
-  }
-  return program<TYPE> { id };
+  program_sources.insert(program_sources.end(), sources, sources + count);
+  return program_sources;
+}
+
+template<GLuint TYPE>
+program<TYPE>
+make_program(GL const & gl, GLsizei count, GLchar const * const * sources, specialization const & constants) {
+  auto all_sources = program_sources(gl.subgroup_arithmetic, count, sources);
+  auto id = create_program(gl, TYPE, GLsizei(all_sources.size()), all_sources.data(), constants);
+  if (!gl.parallel_compile) check_program(gl, id);
+  return program<TYPE> { id, !gl.parallel_compile };
+}
+
+template<GLuint TYPE, typename... Sources>
+program<TYPE>
+make_program(GL const & gl, Sources... sources) {
+  GLchar const * const array_sources[] = { sources... };
+  return make_program<TYPE>(gl, GLsizei(ARRAYSIZE(array_sources)), array_sources,
+    specialization { 0, nullptr, nullptr });
 }
 
 using vertex_program = program<GL_VERTEX_SHADER>;
@@ -181,7 +468,7 @@ struct pipeline {
   pipeline & use(GL const & gl, program<GL_VERTEX_SHADER> const & program) { gl.UseProgramStages(id, GL_VERTEX_SHADER_BIT, program.id); return *this; }
   pipeline & use(GL const & gl, program<GL_FRAGMENT_SHADER> const & program) { gl.UseProgramStages(id, GL_FRAGMENT_SHADER_BIT, program.id); return *this; }
   void rect(GL const & gl) {
-    gl.UseProgram(0);
+    gl.use_program(0);
     gl.BindProgramPipeline(id);
     glRects(-1, -1, 1, 1);
   }
@@ -2,12 +2,184 @@
 
 #include <parallel/gl/opengl.hh>
 
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+
 namespace parallel {
 namespace gl {
 
+enum class order { ascending, descending };
+
+// Key traits of the typed sorts: uint32_t, int32_t, float, uint64_t, int64_t
+// and double keys.
+template<typename Key> struct radix_key;
+template<> struct radix_key<uint32_t> { enum { is_signed = 0, is_float = 0, is_64bit = 0 }; };
+template<> struct radix_key<int32_t>  { enum { is_signed = 1, is_float = 0, is_64bit = 0 }; };
+template<> struct radix_key<float>    { enum { is_signed = 0, is_float = 1, is_64bit = 0 }; };
+template<> struct radix_key<uint64_t> { enum { is_signed = 0, is_float = 0, is_64bit = 1 }; };
+template<> struct radix_key<int64_t>  { enum { is_signed = 1, is_float = 0, is_64bit = 1 }; };
+template<> struct radix_key<double>   { enum { is_signed = 0, is_float = 1, is_64bit = 1 }; };
+
+// A value is moved as sizeof(Value) / 4 words, void sorts the keys only.
+template<typename Value> struct radix_value {
+  static_assert(sizeof(Value) % sizeof(GLuint) == 0 && sizeof(Value) <= 8 * sizeof(GLuint),
+    "radix_sort: values are 4 to 32 bytes in whole 32-bit words");
+  enum { words = sizeof(Value) / sizeof(GLuint) };
+};
+template<> struct radix_value<void> { enum { words = 0 }; };
+
+// A sort variant in terms of the sort() arguments, value_words is 0 for keys
+// only sorts. Each variant runs kernels of its own, built on first use with
+// the variant as constants, or specialized from gl.spirv_modules.
+struct radix_config {
+  GLuint bits_per_pass;
+  bool descending, is_signed, is_float, onesweep, is_64bit;
+  GLuint value_words;
+
+  template<typename Key, typename Value = void, order Order = order::ascending>
+  static radix_config of(GLuint bits_per_pass = 8, bool onesweep = false) {
+    return radix_config { bits_per_pass, Order == order::descending, radix_key<Key>::is_signed != 0,
+      radix_key<Key>::is_float != 0, onesweep, radix_key<Key>::is_64bit != 0, GLuint(radix_value<Value>::words) };
+  }
+};
+
+// Kernels and transient buffers of the sorts on one context. An engine made by
+// share() for a context of the same share group builds no kernel again, it
+// waits for the build of the engine that first needed it instead, and only
+// locks until it has every kernel it dispatches. release() deletes the
+// buffers, and with the last engine of the share group the kernels, while its
+// context is current. instance() is an engine per thread, which shares no
+// kernels with the other threads.
+struct radix_sort_engine {
+  struct kernel_cache;
+  struct state;
+  std::shared_ptr<kernel_cache> cache;
+  std::unique_ptr<state> local;
+
+  radix_sort_engine();
+  radix_sort_engine(radix_sort_engine && other);
+  ~radix_sort_engine();
+  radix_sort_engine share() const;
+  void warm_up(GL const & gl, std::initializer_list<radix_config> configs);
+  void prepare(GL const & gl);
+  void release(GL const & gl);
+  static radix_sort_engine & instance();
+};
+
+// Sorts with a scratch buffer kept between calls, which grows by at least half
+// of its capacity when a sort needs more and is only released by trim().
+// With is_64bit keys are (low, high) word pairs, sorted as int64_t with
+// is_signed and as double with is_float. Every element of index is a value
+// of value_words 32-bit words, up to 8, moved along with its key.
+struct radix_sorter {
+  radix_sort_engine * engine = nullptr; // instance() of the sorting thread when null
+  buffer scratch = buffer::empty();
+  GLsizeiptr capacity = 0;
+  bool attached = false;
+
+  radix_sorter() = default;
+  explicit radix_sorter(radix_sort_engine & engine) : engine(&engine) {}
+
+  static GLsizeiptr scratch_size(GL const & gl, GLsizeiptr count, bool with_index = true,
+    GLuint bits_per_pass = 8, bool onesweep = false, bool is_64bit = false, GLuint value_words = 1);
+  void reserve(GL const & gl, GLsizeiptr count, bool with_index = true,
+    GLuint bits_per_pass = 8, bool onesweep = false, bool is_64bit = false, GLuint value_words = 1);
+  static GLsizeiptr segments_scratch_size(GL const & gl, GLsizeiptr count, GLsizeiptr segments,
+    bool with_index = true, GLuint bits_per_pass = 8, bool is_64bit = false, GLuint value_words = 1);
+  // Sorts in a caller owned scratch buffer of scratch_size() bytes from now
+  // on, which is never reallocated, until trim().
+  void attach(buffer scratch, GLsizeiptr size);
+  void trim(GL const & gl);
+
+  // Up to 8192 keys sort in a single work group and dispatch, ignoring
+  // onesweep. More keys skip the passes of a constant digit, keys in order
+  // run none and keys in strictly reverse order are reversed in place.
+  void sort(GL const & gl, buffer key, GLsizeiptr size = 0, buffer index = buffer::empty(),
+    bool descending = false, bool is_signed = false, bool is_float = false,
+    GLuint bits_per_pass = 8, bool onesweep = false, bool is_64bit = false, GLuint value_words = 1);
+  // Sorts as many keys as the GLuint at count_offset of count holds, up to
+  // capacity, with no readback. Takes the multi-pass path and the scratch of
+  // capacity keys.
+  void sort(GL const & gl, buffer key, buffer count, GLintptr count_offset, GLsizeiptr capacity,
+    buffer index = buffer::empty(), bool descending = false, bool is_signed = false, bool is_float = false,
+    GLuint bits_per_pass = 8, bool onesweep = false, bool is_64bit = false, GLuint value_words = 1);
+  // Queues the work of sort(), the fence signals once the keys are sorted.
+  fence sort_async(GL const & gl, buffer key, GLsizeiptr size = 0, buffer index = buffer::empty(),
+    bool descending = false, bool is_signed = false, bool is_float = false,
+    GLuint bits_per_pass = 8, bool onesweep = false, bool is_64bit = false, GLuint value_words = 1);
+  // Sorts Key keys in Order, and Value values in index unless Value is void.
+  template<typename Key, typename Value = void, order Order = order::ascending>
+  void sort(GL const & gl, buffer key, GLsizeiptr size = 0, buffer index = buffer::empty(),
+    GLuint bits_per_pass = 8, bool onesweep = false) {
+    sort(gl, key, size, radix_value<Value>::words == 0 ? buffer::empty() : index, Order == order::descending,
+      radix_key<Key>::is_signed != 0, radix_key<Key>::is_float != 0, bits_per_pass, onesweep,
+      radix_key<Key>::is_64bit != 0, radix_value<Value>::words == 0 ? 1 : GLuint(radix_value<Value>::words));
+  }
+  // Sorts each segment [offsets[i], offsets[i + 1]) on its own, offsets holds
+  // segments + 1 ascending positions from 0 to size. Segments up to 512 keys
+  // sort in local memory, up to 16384 by a work group each, longer ones like
+  // a whole sort.
+  void sort_segments(GL const & gl, buffer key, GLsizeiptr size, buffer offsets, GLsizeiptr segments,
+    buffer index = buffer::empty(), bool descending = false, bool is_signed = false, bool is_float = false,
+    GLuint bits_per_pass = 8, bool is_64bit = false, GLuint value_words = 1);
+  // Sorts arrays consecutive arrays of array_size keys, up to 1024, in one
+  // dispatch with a work group for each array and no scratch.
+  void sort_batch(GL const & gl, buffer key, GLsizeiptr array_size, GLsizeiptr arrays,
+    buffer index = buffer::empty(), bool descending = false, bool is_signed = false, bool is_float = false,
+    bool is_64bit = false, GLuint value_words = 1);
+private:
+  radix_sort_engine & sort_engine() const { return engine != nullptr ? *engine : radix_sort_engine::instance(); }
+  void grow(GL const & gl, GLsizeiptr size);
+  void sort_keys(GL const & gl, buffer key, GLsizeiptr count, buffer count_buffer, GLintptr count_offset,
+    buffer index, bool descending, bool is_signed, bool is_float, GLuint bits_per_pass, bool onesweep, bool is_64bit,
+    GLuint value_words);
+};
+
+// The radix_sort() functions sort with a sorter of radix_sort_engine::instance(),
+// whose scratch and buffers belong to the context current on the thread of its
+// first call.
 void radix_sort(GL const & gl, buffer key, GLsizeiptr size = 0, buffer index = buffer::empty(),
-  bool descending = false, bool is_signed = false, bool is_float = false);
+  bool descending = false, bool is_signed = false, bool is_float = false,
+  GLuint bits_per_pass = 8, bool onesweep = false, bool is_64bit = false, GLuint value_words = 1);
 
+template<typename Key, typename Value = void, order Order = order::ascending>
+void radix_sort(GL const & gl, buffer key, GLsizeiptr size = 0, buffer index = buffer::empty(),
+  GLuint bits_per_pass = 8, bool onesweep = false) {
+  radix_sort(gl, key, size, radix_value<Value>::words == 0 ? buffer::empty() : index, Order == order::descending,
+    radix_key<Key>::is_signed != 0, radix_key<Key>::is_float != 0, bits_per_pass, onesweep,
+    radix_key<Key>::is_64bit != 0, radix_value<Value>::words == 0 ? 1 : GLuint(radix_value<Value>::words));
 }
-}
 
+void radix_sort(GL const & gl, buffer key, buffer count, GLintptr count_offset, GLsizeiptr capacity,
+  buffer index = buffer::empty(), bool descending = false, bool is_signed = false, bool is_float = false,
+  GLuint bits_per_pass = 8, bool onesweep = false, bool is_64bit = false, GLuint value_words = 1);
+
+fence radix_sort_async(GL const & gl, buffer key, GLsizeiptr size = 0, buffer index = buffer::empty(),
+  bool descending = false, bool is_signed = false, bool is_float = false,
+  GLuint bits_per_pass = 8, bool onesweep = false, bool is_64bit = false, GLuint value_words = 1);
+
+// Builds the kernels of the given variants ahead of their first sort. With
+// parallel_compile it only starts their links, and a sort waits for the
+// kernels it dispatches alone.
+void radix_sort_warm_up(GL const & gl, std::initializer_list<radix_config> configs);
+
+// Warms up unsigned 32-bit keys in ascending order with and without one word values.
+void radix_sort_prepare(GL const & gl);
+
+// Calls f with the program sources of every kernel, on a device with and
+// without subgroup arithmetic, which SPIR-V modules are built from.
+void radix_sort_kernel_sources(
+  std::function<void(bool subgroup_arithmetic, GLsizei count, GLchar const * const * sources)> const & f);
+
+void radix_sort_segments(GL const & gl, buffer key, GLsizeiptr size, buffer offsets, GLsizeiptr segments,
+  buffer index = buffer::empty(), bool descending = false, bool is_signed = false, bool is_float = false,
+  GLuint bits_per_pass = 8, bool is_64bit = false, GLuint value_words = 1);
+
+void radix_sort_batch(GL const & gl, buffer key, GLsizeiptr array_size, GLsizeiptr arrays,
+  buffer index = buffer::empty(), bool descending = false, bool is_signed = false, bool is_float = false,
+  bool is_64bit = false, GLuint value_words = 1);
+
+}
+}
@@ -30,6 +30,22 @@ project "parallel-gl"
         , "include/GL/**.h"
         }
 
+-- SPIR-V modules of the kernels for GL::spirv_modules, built into build/spirv
+-- by glslangValidator of the Vulkan SDK or the glslang package.
+project "parallel-gl-modules"
+  kind "consoleapp"
+  language "c++"
+  links { "parallel-gl" }
+
+  files { "tools/gl-modules.cc" }
+
+  postbuildcommands { "{MKDIR} %{wks.location}/spirv"
+                    , "\"%{cfg.buildtarget.abspath}\" \"%{wks.location}/spirv\""
+                    }
+
+  filter "system:not windows"
+    links { "EGL", "GL" }
+
 project "parallel-amp"
   kind "staticlib"
   language "c++"
@@ -38,6 +54,14 @@ project "parallel-amp"
         , "include/parallel/amp/**.hh"
         }
 
+project "parallel-cpu"
+  kind "staticlib"
+  language "c++"
+
+  files { "sources/cpu/**.cc"
+        , "include/parallel/cpu/**.hh"
+        }
+
 project "parallel-tests-gl"
   kind "consoleapp"
   language "c++"
@@ -45,9 +69,22 @@ project "parallel-tests-gl"
 
   files { "tests/test-gl.cc" }
 
+  filter "system:not windows"
+    links { "EGL", "GL", "pthread" }
+
 project "parallel-tests-amp"
   kind "consoleapp"
   language "c++"
   links { "parallel-amp" }
 
   files { "tests/test-amp.cc" }
+
+project "parallel-tests-cpu"
+  kind "consoleapp"
+  language "c++"
+  links { "parallel-cpu" }
+
+  files { "tests/test-cpu.cc" }
+
+  filter "system:not windows"
+    links { "pthread" }
@@ -30,12 +30,23 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <type_traits>
 #include <amp_graphics.h>
 
-#define WG_COUNT 64
+#define MAX_WG_COUNT 1024 // bounds the histogram, far more tiles than any device keeps resident
+#define GROUP_BLOCKS 8    // blocks a tile of a pass scans at least
 #define WG_SIZE 256
 #define BLOCK_SIZE 1024  // (4 * WG_SIZE)
-#define BITS_PER_PASS 4
-#define RADICES 16       // (1 << BITS_PER_PASS)
-#define RADICES_MASK 0xf // (RADICES - 1)
+#define SLOT_BITS 10     // positions within a block, packed below the digits sort_bits moves
+#define RANK_BITS 4      // digit bits sort_bits ranks at a time
+#define RANK_RADICES 16  // (1 << RANK_BITS)
+#define MAX_BITS_PER_PASS 11
+#define HISTOGRAM_SIZE 4096 // tile_static counters of histogram_count
+#define MAX_VALUE_WORDS 8 // 32-byte values
+#define STAGED_VALUE_WORDS 4 // wider values are read in sorted order from global memory
+
+// BITS_PER_PASS is the template parameter of the kernels
+#define RADICES (1u << BITS_PER_PASS)
+#define RADICES_MASK (RADICES - 1)
+#define HISTOGRAM_COPIES (HISTOGRAM_SIZE / RADICES < WG_SIZE ? HISTOGRAM_SIZE / RADICES : WG_SIZE)
+#define EACH_RADIX(d) for (uint d = LC_IDX; d < RADICES; d += WG_SIZE)
 
 #define BARRIER t_idx.barrier.wait()
 
@@ -47,11 +58,22 @@ using namespace concurrency::graphics;
 template<typename T> T to_mask(T n) restrict(cpu, amp) { return (1 << n) - 1; }
 template<typename T> T bfe(T src, uint shift, uint n) restrict(cpu, amp)
 { return (src >> shift) & to_mask(n); }
-template<typename T> T bfe_sign(T src, uint shift, uint n) restrict(cpu, amp)
-{ return ((((src >> shift) & to_mask(n - 1))
-                           ^ to_mask(n - 1))
-                           & to_mask(n - 1))
-  | ((src >> shift) & (1 << (n - 1))); }
+// bits of the lo/hi word pair starting at shift, shift may be up to 63
+template<typename T> T bits_at(T lo, T hi, uint shift) restrict(cpu, amp) {
+  return shift >= 32 ? hi >> (shift - 32)
+    : shift == 0 ? lo
+    : (lo >> shift) | (hi << (32 - shift));
+}
+// keys stay as they are in memory and are ordered here, a negative float
+// flips every bit and a positive one only its sign, which is in the top word
+template<uint BITS_PER_PASS, uint KEY_WORDS, typename T>
+T digit(T lo, T hi, uint shift, uint flip_lo, uint flip_hi, bool is_float) restrict(cpu, amp) {
+  const T negative = is_float ? T(0) - ((KEY_WORDS == 1 ? lo : hi) >> 31) : T(0);
+  const T sign = T(is_float ? 0x80000000 : 0);
+  lo ^= KEY_WORDS == 1 ? negative | sign : negative;
+  hi ^= KEY_WORDS == 1 ? T(0) : negative | sign;
+  return bits_at(lo ^ flip_lo, hi ^ flip_hi, shift) & to_mask(BITS_PER_PASS);
+}
 
 template<typename T>
 T clamp(T x, T minVal, T maxVal) restrict(cpu, amp) { return min(max(x, minVal), maxVal); }
@@ -96,33 +118,51 @@ void set_by(T dest, uint_4 idx, S val, uint_4 flag) restrict(cpu, amp) {
   if (flag.z) dest[idx.z] = val.z;
   if (flag.w) dest[idx.w] = val.w;
 }
+// keys are KEY_WORDS words each, the low word first
+template<uint KEY_WORDS, typename T>
+void get_keys(T src, uint_4 idx, uint_4 & lo, uint_4 & hi) restrict(cpu, amp) {
+  lo = get_by(src, idx * KEY_WORDS);
+  hi = KEY_WORDS == 1 ? uint_4(0) : get_by(src, idx * KEY_WORDS + 1);
+}
 struct blocks_info { uint count; uint offset; };
-blocks_info get_blocks_info(const uint n, const uint wg_idx) restrict(cpu, amp) {
+blocks_info get_blocks_info(const uint n, const uint wg_idx, const uint groups) restrict(cpu, amp) {
   const uint aligned = n + BLOCK_SIZE - (n % BLOCK_SIZE);
   const uint blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
-  const uint blocks_per_wg = (blocks + WG_COUNT - 1) / WG_COUNT;
+  const uint blocks_per_wg = (blocks + groups - 1) / groups;
   const int n_blocks = int(aligned / BLOCK_SIZE) - int(blocks_per_wg * wg_idx);
   return blocks_info {
     uint(clamp(n_blocks, 0, int(blocks_per_wg))),
     blocks_per_wg * BLOCK_SIZE * wg_idx
   };
 }
+// Blelloch scan, C++ AMP has no wave intrinsics to scan subgroups with
 uint prefix_sum(uint data, uint & total_sum, tiled_index<WG_SIZE> t_idx) restrict(amp) {
-  tile_static uint local_sort[WG_SIZE * 2];
+  tile_static uint local_sort[WG_SIZE + 1];
   const auto LC_IDX = t_idx.local[0];
-  local_sort[LC_IDX] = 0;
-  const auto lc_idx = LC_IDX + WG_SIZE;
-  local_sort[lc_idx] = data;
+  local_sort[LC_IDX] = data;
   BARRIER;
 
-  for (uint i = 1; i < WG_SIZE; i <<= 1) {
-    uint tmp = local_sort[lc_idx - i];
+  for (uint d = 1; d < WG_SIZE; d <<= 1) {
+    const auto i = (LC_IDX + 1) * 2 * d - 1;
+    if (i < WG_SIZE) local_sort[i] += local_sort[i - d];
     BARRIER;
-    local_sort[lc_idx] += tmp;
+  }
+  if (LC_IDX == 0) {
+    local_sort[WG_SIZE] = local_sort[WG_SIZE - 1];
+    local_sort[WG_SIZE - 1] = 0;
+  }
+  BARRIER;
+  for (uint d = WG_SIZE / 2; d > 0; d >>= 1) {
+    const auto i = (LC_IDX + 1) * 2 * d - 1;
+    if (i < WG_SIZE) {
+      const auto tmp = local_sort[i - d];
+      local_sort[i - d] = local_sort[i];
+      local_sort[i] += tmp;
+    }
     BARRIER;
   }
-  total_sum = local_sort[WG_SIZE * 2 - 1];
-  return local_sort[lc_idx - 1];
+  total_sum = local_sort[WG_SIZE];
+  return local_sort[LC_IDX];
 }
 uint prefix_scan(uint_4 & v) restrict(cpu, amp) {
   uint sum = 0;
@@ -133,91 +173,134 @@ uint prefix_scan(uint_4 & v) restrict(cpu, amp) {
   tmp = v.w; v.w = sum; sum += tmp;
   return sum;
 }
-void sort_bits(uint_4 & sort, uint_4 & sort_val,
-  tiled_index<WG_SIZE> t_idx, uint * local_sort, uint * local_sort_val,
-  uint shift, bool descending, bool is_signed) restrict(amp) {
-  auto signs = bfe_sign(sort, shift, BITS_PER_PASS);
+// counts a key in the 16-bit counter at half_shift of word, returns the count before it
+uint count_rank(uint * local_rank, uint word, uint half_shift) restrict(amp) {
+  const auto rank = bfe(local_rank[word], half_shift, 16u);
+  local_rank[word] += 1u << half_shift;
+  return rank;
+}
+// Sorts a block stably by bits wide digits, RANK_BITS at a time. Every thread
+// counts its keys in a column of 16-bit counters, two digits apart by
+// RANK_RADICES / 2 to a word, the columns are scanned in digit order with
+// one prefix_sum and every key is ranked in a single step. C++ AMP has no
+// wave intrinsics for a multisplit ranking a digit in one round, which saves
+// about 30% of an 8-bit sort by the GL kernels.
+void sort_bits(uint_4 & digit, uint_4 & slot, uint bits,
+  tiled_index<WG_SIZE> t_idx, uint * local_sort, uint * local_rank) restrict(amp) {
   const auto LC_IDX = t_idx.local[0];
   const auto addr = 4 * LC_IDX + uint_4(0, 1, 2, 3);
-  EACH(i_bit, BITS_PER_PASS) {
-    const auto mask = (1 << i_bit);
-    const auto cmp = equal((is_signed ? signs : (sort >> shift)) & mask, uint_4(descending != is_signed) * mask);
-    auto key = cmp;
-    uint total;
-    key += prefix_sum(prefix_scan(key), total, t_idx);
+  for (uint i_bit = 0; i_bit < bits; i_bit += RANK_BITS) {
+    const auto sub_digit = bfe(digit, i_bit, bits - i_bit < RANK_BITS ? bits - i_bit : RANK_BITS);
+    const auto word = (sub_digit % (RANK_RADICES / 2)) * WG_SIZE + LC_IDX;
+    const auto half_shift = (sub_digit / (RANK_RADICES / 2)) * 16;
+    EACH(i, RANK_RADICES / 2) local_rank[i * WG_SIZE + LC_IDX] = 0;
+    uint_4 rank;
+    rank.x = count_rank(local_rank, word.x, half_shift.x);
+    rank.y = count_rank(local_rank, word.y, half_shift.y);
+    rank.z = count_rank(local_rank, word.z, half_shift.z);
+    rank.w = count_rank(local_rank, word.w, half_shift.w);
     BARRIER;
 
-    const uint_4 dest_addr = mix(key, addr - key + total, cmp);
-    set_by(local_sort, dest_addr, sort);
-    set_by(local_sort_val, dest_addr, sort_val);
+    const auto raking = LC_IDX * (RANK_RADICES / 2);
+    uint sum = 0;
+    EACH(i, RANK_RADICES / 2) sum += local_rank[raking + i];
+    uint total;
+    auto seed = prefix_sum(sum, total, t_idx);
+    EACH(i, RANK_RADICES / 2) {
+      const auto count = local_rank[raking + i];
+      local_rank[raking + i] = seed + (total << 16);
+      seed += count;
+    }
     BARRIER;
 
-    sort = get_by(local_sort, addr);
-    sort_val = get_by(local_sort_val, addr);
+    rank += (get_by(local_rank, word) >> half_shift) & 0xffffu;
+    set_by(local_sort, rank, (digit << SLOT_BITS) | slot);
     BARRIER;
 
-    if (is_signed) {
-      set_by(local_sort, dest_addr, signs);
-      BARRIER;
+    const auto sorted = get_by(local_sort, addr);
+    digit = sorted >> SLOT_BITS;
+    slot = sorted & to_mask(SLOT_BITS);
+    BARRIER;
+  }
+}
 
-      signs = get_by(local_sort, addr);
-      BARRIER;
-    }
+template<uint BITS_PER_PASS>
+void scan_radices(tiled_index<WG_SIZE> t_idx,
+  uint * local_histogram, uint * local_histogram_to_carry) restrict(amp) {
+  const auto LC_IDX = t_idx.local[0];
+  const uint count = (RADICES + WG_SIZE - 1) / WG_SIZE;
+  const uint offset = LC_IDX * count;
+  const uint end = offset + count < RADICES ? offset + count : RADICES;
+  uint sum = 0;
+  for (uint d = offset; d < end; d++) sum += local_histogram[d];
+  uint total;
+  auto seed = prefix_sum(sum, total, t_idx);
+  for (uint d = offset; d < end; d++) {
+    const auto tmp = local_histogram[d];
+    local_histogram[d] = local_histogram_to_carry[d] - seed;
+    local_histogram_to_carry[d] += tmp;
+    seed += tmp;
   }
+  BARRIER;
 }
 
+template<uint BITS_PER_PASS, uint KEY_WORDS>
 void histogram_count(
   tiled_index<WG_SIZE> t_idx,
   array_view<uint> data_key_in,
   array_view<uint> histogram,
+  uint groups,
   uint shift,
-  bool descending,
-  bool is_signed) restrict(amp) {
-  tile_static uint local_histogram[WG_SIZE * RADICES];
+  uint flip_lo,
+  uint flip_hi,
+  bool is_float) restrict(amp) {
+  tile_static uint local_histogram[RADICES * HISTOGRAM_COPIES];
   const auto LC_IDX = t_idx.local[0];
   const auto WG_IDX = t_idx.tile[0];
-  EACH(i, RADICES) local_histogram[i * WG_SIZE + LC_IDX] = 0;
+  for (uint i = LC_IDX; i < RADICES * HISTOGRAM_COPIES; i += WG_SIZE) local_histogram[i] = 0;
   BARRIER;
-  const auto n = data_key_in.extent.size();
-  const auto blocks = get_blocks_info(n, WG_IDX);
+  const uint n = data_key_in.extent.size() / KEY_WORDS;
+  const auto blocks = get_blocks_info(n, WG_IDX, groups);
   auto addr = blocks.offset + 4 * LC_IDX + uint_4(0, 1, 2, 3);
   EACH(i_block, blocks.count) {
     const auto less_than = lessThan(addr, uint_4(n));
-    const auto data_vec = get_by(data_key_in, addr);
-    const auto k = is_signed
-      ? bfe_sign(data_vec, shift, BITS_PER_PASS)
-      : bfe(data_vec, shift, BITS_PER_PASS);
-    const auto key = descending != is_signed ? (RADICES_MASK - k) : k;
-    const auto local_key = key * WG_SIZE + LC_IDX;
+    uint_4 data_vec, data_hi_vec;
+    get_keys<KEY_WORDS>(data_key_in, addr, data_vec, data_hi_vec);
+    const auto local_key = digit<BITS_PER_PASS, KEY_WORDS>(data_vec, data_hi_vec, shift, flip_lo, flip_hi, is_float) * HISTOGRAM_COPIES
+      + LC_IDX % HISTOGRAM_COPIES;
     inc_by(local_histogram, local_key, less_than);
     addr += BLOCK_SIZE;
   }
   BARRIER;
-  if (LC_IDX < RADICES) {
-    uint sum = 0; EACH(i, WG_SIZE) sum += local_histogram[LC_IDX * WG_SIZE + i];
-    histogram[LC_IDX * WG_COUNT + WG_IDX] = sum;
+  EACH_RADIX(d) {
+    uint sum = 0; for (uint i = 0; i < HISTOGRAM_COPIES; i++) sum += local_histogram[d * HISTOGRAM_COPIES + i];
+    histogram[d * groups + WG_IDX] = sum;
   }
 }
 
-void prefix_sum(tiled_index<WG_SIZE> t_idx, array_view<uint> histogram) restrict(amp) {
-  tile_static uint seed;
+// The histogram holds a row of groups counts for every digit, followed by
+// the digit totals. Every tile scans the row of its digit into offsets within
+// the digit and stores its total, permute adds the offsets of the digits.
+template<uint BITS_PER_PASS>
+void prefix_sum(tiled_index<WG_SIZE> t_idx, array_view<uint> histogram, uint groups) restrict(amp) {
   const auto LC_IDX = t_idx.local[0];
-  const auto WG_IDX = t_idx.tile[0];
-  seed = 0;
-  BARRIER;
-
-  EACH(d, RADICES) {
-    auto val = 0u;
-    auto idx = d * WG_COUNT + LC_IDX;
-    if (LC_IDX < WG_COUNT) val = histogram[idx];
-    uint total;
-    auto res = prefix_sum(val, total, t_idx);
-    if (LC_IDX < WG_COUNT) histogram[idx] = res + seed;
-    if (LC_IDX == WG_COUNT - 1) seed += res + val;
-    BARRIER;
+  const auto row = t_idx.tile[0] * groups;
+  const uint count = (groups + WG_SIZE - 1) / WG_SIZE;
+  const uint offset = LC_IDX * count;
+  const uint end = offset + count < groups ? offset + count : groups;
+  uint sum = 0;
+  for (uint i = offset; i < end; i++) sum += histogram[row + i];
+  uint total;
+  auto seed = prefix_sum(sum, total, t_idx);
+  for (uint i = offset; i < end; i++) {
+    const auto tmp = histogram[row + i];
+    histogram[row + i] = seed;
+    seed += tmp;
   }
+  if (LC_IDX == 0) histogram[RADICES * groups + t_idx.tile[0]] = total;
 }
 
+template<uint BITS_PER_PASS, uint KEY_WORDS>
 void permute(
   tiled_index<WG_SIZE> t_idx,
   array_view<uint> data_key_in,
@@ -225,152 +308,215 @@ void permute(
   array_view<uint> data_key_out,
   array_view<uint> data_index_out,
   array_view<uint> histogram,
+  uint groups,
   uint shift,
-  bool descending,
-  bool is_signed,
-  bool key_index) restrict(amp) {
+  uint flip_lo,
+  uint flip_hi,
+  bool is_float,
+  bool key_index,
+  uint value_words) restrict(amp) {
   tile_static uint local_histogram_to_carry[RADICES];
-  tile_static uint local_histogram[RADICES * 2];
+  tile_static uint local_histogram[RADICES];
   tile_static uint local_sort[BLOCK_SIZE];
-  tile_static uint local_sort_val[BLOCK_SIZE];
+  tile_static uint local_rank[RANK_RADICES / 2 * WG_SIZE];
   const auto LC_IDX = t_idx.local[0];
   const auto WG_IDX = t_idx.tile[0];
-  const uint carry_idx = (descending && !is_signed ? (RADICES_MASK - LC_IDX) : LC_IDX);
-  if (LC_IDX < RADICES) local_histogram_to_carry[LC_IDX] = histogram[carry_idx * WG_COUNT + WG_IDX];
-  BARRIER;
+  {
+    const uint totals = RADICES * groups;
+    const uint count = (RADICES + WG_SIZE - 1) / WG_SIZE;
+    const uint start = LC_IDX * count;
+    const uint end = start + count < RADICES ? start + count : RADICES;
+    uint sum = 0;
+    for (uint d = start; d < end; d++) sum += histogram[totals + d];
+    uint total;
+    auto seed = prefix_sum(sum, total, t_idx);
+    for (uint d = start; d < end; d++) {
+      local_histogram_to_carry[d] = seed + histogram[d * groups + WG_IDX];
+      seed += histogram[totals + d];
+    }
+    BARRIER;
+  }
 
-  const uint def = (uint(!descending) * 0xffffffff) ^ (uint(is_signed) * 0x80000000);
-  const uint n = data_key_in.extent.size();
-  const auto blocks = get_blocks_info(n, WG_IDX);
-  uint_4 addr = blocks.offset + 4 * LC_IDX + uint_4(0, 1, 2, 3);
+  const uint n = data_key_in.extent.size() / KEY_WORDS;
+  const auto blocks = get_blocks_info(n, WG_IDX, groups);
+  const auto local_addr = 4 * LC_IDX + uint_4(0, 1, 2, 3);
+  uint_4 addr = blocks.offset + local_addr;
   EACH(i_block, blocks.count) {
     const auto less_than = lessThan(addr, uint_4(n));
-    const auto less_than_val = lessThan(addr, uint_4(key_index ? n : 0));
-    const auto data_vec = get_by(data_key_in, addr);
-    const auto data_val_vec = get_by(data_index_in, addr);
-    auto sort = mix(data_vec, def, less_than);
-    auto sort_val = mix(data_val_vec, 0, less_than_val);
-    sort_bits(sort, sort_val, t_idx, local_sort, local_sort_val, shift, descending, is_signed);
-    auto k = is_signed
-      ? bfe_sign(sort, shift, BITS_PER_PASS)
-      : bfe(sort, shift, BITS_PER_PASS);
-    const auto key = (descending != is_signed) ? (RADICES_MASK - k) : k;
-    const auto hist_key = key + RADICES;
-    const auto local_key = key + (LC_IDX / RADICES) * RADICES;
-    k = is_signed ? key : k;
-    const auto offset = get_by(local_histogram_to_carry, k) + 4 * LC_IDX + uint_4(0, 1, 2, 3);
-    local_sort[LC_IDX] = 0;
-    BARRIER;
-
-    inc_by(local_sort, local_key, less_than);
+    uint_4 data_vec, data_hi_vec;
+    get_keys<KEY_WORDS>(data_key_in, addr, data_vec, data_hi_vec);
+    uint_4 digit_vec = mix(digit<BITS_PER_PASS, KEY_WORDS>(data_vec, data_hi_vec, shift, flip_lo, flip_hi, is_float),
+      RADICES_MASK, less_than);
+    uint_4 slot = local_addr;
+    EACH_RADIX(d) local_histogram[d] = 0;
     BARRIER;
 
-    const auto lc_idx = LC_IDX + RADICES;
-    if (LC_IDX < RADICES) {
-      local_histogram[LC_IDX] = 0;
-      uint sum = 0; EACH(i, WG_SIZE / RADICES) sum += local_sort[i * RADICES + LC_IDX];
-      local_histogram_to_carry[carry_idx] += local_histogram[lc_idx] = sum;
-    }
-    BARRIER;
+    inc_by(local_histogram, digit_vec, less_than);
+    sort_bits(digit_vec, slot, BITS_PER_PASS, t_idx, local_sort, local_rank);
+    scan_radices<BITS_PER_PASS>(t_idx, local_histogram, local_histogram_to_carry);
 
-    uint tmp = 0;
-    if (LC_IDX < RADICES) local_histogram[lc_idx] = local_histogram[lc_idx - 1];
-    BARRIER;
-    if (LC_IDX < RADICES) tmp = local_histogram[lc_idx - 3]
-                              + local_histogram[lc_idx - 2]
-                              + local_histogram[lc_idx - 1];
-    BARRIER;
-    if (LC_IDX < RADICES) local_histogram[lc_idx] += tmp;
-    BARRIER;
-    if (LC_IDX < RADICES) tmp = local_histogram[lc_idx - 12]
-                              + local_histogram[lc_idx - 8]
-                              + local_histogram[lc_idx - 4];
-    BARRIER;
-    if (LC_IDX < RADICES) local_histogram[lc_idx] += tmp;
+    const auto out_key = get_by(local_histogram, digit_vec) + local_addr;
+    set_by(local_sort, local_addr, data_vec);
     BARRIER;
-
-    const auto out_key = offset - get_by(local_histogram, hist_key);
-    set_by(data_key_out, out_key, sort, less_than);
-    set_by(data_index_out, out_key, sort_val, less_than_val);
+    const auto sort = get_by(local_sort, slot);
+    set_by(data_key_out, out_key * KEY_WORDS, sort, less_than);
+    if (KEY_WORDS != 1) {
+      BARRIER;
+      set_by(local_sort, local_addr, data_hi_vec);
+      BARRIER;
+      const auto sort_hi = get_by(local_sort, slot);
+      set_by(data_key_out, out_key * KEY_WORDS + 1, sort_hi, less_than);
+    }
+    // narrow values are read coalesced and reordered through local_sort
+    // a word at a time, wider ones are read in sorted order instead
+    if (key_index && value_words <= STAGED_VALUE_WORDS) {
+      EACH(i_word, value_words) {
+        const auto data_val_vec = get_by(data_index_in, addr * value_words + i_word);
+        BARRIER;
+        set_by(local_sort, local_addr, data_val_vec);
+        BARRIER;
+        const auto sort_val = get_by(local_sort, slot);
+        set_by(data_index_out, out_key * value_words + i_word, sort_val, less_than);
+      }
+    } else if (key_index) {
+      const auto source = (addr - local_addr + slot) * value_words;
+      EACH(i_word, value_words) {
+        const auto sort_val = get_by(data_index_in, source + i_word);
+        set_by(data_index_out, out_key * value_words + i_word, sort_val, less_than);
+      }
+    }
     BARRIER;
     addr += BLOCK_SIZE;
   }
 }
 
-void flip_float(
-  tiled_index<WG_SIZE> t_idx,
-  array_view<uint> data,
-  bool invert) restrict(amp) {
-  const auto LC_IDX = t_idx.local[0];
-  const auto WG_IDX = t_idx.tile[0];
-  const uint n = data.extent.size();
-  const auto blocks = get_blocks_info(n, WG_IDX);
-  uint_4 addr = blocks.offset + 4 * LC_IDX + uint_4(0, 1, 2, 3);
-  EACH(i_block, blocks.count) {
-    const auto less_than = lessThan(addr, uint_4(n));
-    const auto data_vec = get_by(data, addr);
-    auto value = mix(data_vec, 0, less_than);
-    auto mask = invert
-      ? (((value >> 31) - 1) | 0x80000000)
-      : uint_4(-int_4(value >> 31) | 0x80000000);
-    value ^= mask;
-    set_by(data, addr, value, less_than);
-    addr += BLOCK_SIZE;
-  }
+// tiles of a pass over count keys, enough for each to scan GROUP_BLOCKS blocks
+// up to MAX_WG_COUNT, as C++ AMP reports no compute unit count
+static uint group_count(size_t count) {
+  auto groups = (count + GROUP_BLOCKS * BLOCK_SIZE - 1) / (GROUP_BLOCKS * BLOCK_SIZE);
+  return uint(groups < 1 ? 1 : groups > MAX_WG_COUNT ? MAX_WG_COUNT : groups);
 }
 
-
-namespace parallel {
-namespace amp {
-
-void radix_sort(concurrency::accelerator_view & av,
-  concurrency::array_view<uint32_t> key, concurrency::array_view<uint32_t> index,
-  bool descending /*= false*/, bool is_signed /*= false*/, bool is_float /*= false*/) {
-  array<uint> histogram(WG_COUNT * RADICES, av);
-  array<uint> key_out(key.extent, av);
-  array<uint> index_out(index.extent, av);
-  auto tile = extent<1>(WG_COUNT * WG_SIZE).tile<WG_SIZE>();
-  auto prefix_tile = extent<1>(WG_SIZE).tile<WG_SIZE>();
+// scratch holds the histogram, the key output and the index output
+template<uint BITS_PER_PASS, uint KEY_WORDS>
+void radix_sort(accelerator_view & av, array_view<uint> key, array_view<uint> index,
+  array_view<uint> scratch, bool descending, bool is_signed, bool is_float, uint value_words) {
+  const int n = key.extent.size() / KEY_WORDS;
+  auto key_index = index.extent.size() != 0;
+  const uint groups = group_count(n);
+  const int histogram_size = (groups + 1) * RADICES;
+  array_view<uint> histogram = scratch.section(0, histogram_size);
+  array_view<uint> key_out = scratch.section(histogram_size, n * KEY_WORDS);
+  array_view<uint> index_out = key_index
+    ? scratch.section(histogram_size + n * KEY_WORDS, n * value_words) : index;
+  auto tile = extent<1>(groups * WG_SIZE).tile<WG_SIZE>();
+  auto prefix_tile = extent<1>(RADICES * WG_SIZE).tile<WG_SIZE>();
   array_view<uint> data_key_in = key;
   array_view<uint> data_key_out = key_out;
   array_view<uint> data_index_in = index;
   array_view<uint> data_index_out = index_out;
-  auto key_index = index.extent.size() != 0;
-  for (uint shift = 0; shift < 32; shift += 4) {
-    if (is_float && shift == 0) {
-      concurrency::parallel_for_each(av, tile,
-      [=](tiled_index<WG_SIZE> t_idx) restrict(amp) {
-        flip_float(t_idx, data_key_in, false);
-      });
-    }
-
+  // the sign bit is in the top word
+  const uint sign = is_signed && !is_float ? 0x80000000 : 0;
+  const uint flip_lo = (descending ? 0xffffffff : 0) ^ (KEY_WORDS == 1 ? sign : 0);
+  const uint flip_hi = KEY_WORDS == 1 ? 0 : (descending ? 0xffffffff : 0) ^ sign;
+  uint passes = 0;
+  for (uint shift = 0; shift < 32 * KEY_WORDS; shift += BITS_PER_PASS, passes++) {
     concurrency::parallel_for_each(av, tile,
-    [=, &histogram](tiled_index<WG_SIZE> t_idx) restrict(amp) {
-      histogram_count(t_idx, data_key_in, histogram,
-        shift, descending, is_signed && shift == 28);
+    [=](tiled_index<WG_SIZE> t_idx) restrict(amp) {
+      histogram_count<BITS_PER_PASS, KEY_WORDS>(t_idx, data_key_in, histogram, groups,
+        shift, flip_lo, flip_hi, is_float);
     });
     concurrency::parallel_for_each(av, prefix_tile,
-    [=, &histogram](tiled_index<WG_SIZE> t_idx) restrict(amp) {
-      prefix_sum(t_idx, histogram);
+    [=](tiled_index<WG_SIZE> t_idx) restrict(amp) {
+      prefix_sum<BITS_PER_PASS>(t_idx, histogram, groups);
     });
     concurrency::parallel_for_each(av, tile,
-    [=, &histogram](tiled_index<WG_SIZE> t_idx) restrict(amp) {
-      permute(t_idx, data_key_in, data_index_in,
-        data_key_out, data_index_out, histogram,
-        shift, descending, is_signed && shift == 28, key_index);
+    [=](tiled_index<WG_SIZE> t_idx) restrict(amp) {
+      permute<BITS_PER_PASS, KEY_WORDS>(t_idx, data_key_in, data_index_in,
+        data_key_out, data_index_out, histogram, groups,
+        shift, flip_lo, flip_hi, is_float, key_index, value_words);
     });
     std::swap(data_key_in, data_key_out);
     std::swap(data_index_in, data_index_out);
   }
 
-  if (is_float) {
-    concurrency::parallel_for_each(av, tile,
-    [=](tiled_index<WG_SIZE> t_idx) restrict(amp) {
-      flip_float(t_idx, data_key_in, true);
-    });
+  if (passes % 2 != 0) { // odd pass count leaves the result in the output arrays
+    data_key_in.copy_to(key);
+    if (key_index) data_index_in.copy_to(index);
   }
 }
 
+static uint32_t clamp_bits(uint32_t bits_per_pass) {
+  return bits_per_pass < 1 ? 1 : bits_per_pass > MAX_BITS_PER_PASS ? MAX_BITS_PER_PASS : bits_per_pass;
+}
+
+namespace parallel {
+namespace amp {
+
+size_t radix_sorter::scratch_size(size_t count, bool with_index /*= true*/, uint32_t bits_per_pass /*= 8*/,
+  bool is_64bit /*= false*/, uint32_t value_words /*= 1*/) {
+  return ((group_count(count) + 1) << clamp_bits(bits_per_pass))
+    + count * ((is_64bit ? 2 : 1) + (with_index ? value_words : 0));
+}
+
+void radix_sorter::reserve(accelerator_view & av, size_t count, bool with_index /*= true*/,
+  uint32_t bits_per_pass /*= 8*/, bool is_64bit /*= false*/, uint32_t value_words /*= 1*/) {
+  auto required = scratch_size(count, with_index, bits_per_pass, is_64bit, value_words);
+  if (!attached && required > capacity) grow(av, required);
+}
+
+void radix_sorter::grow(accelerator_view & av, size_t size) {
+  scratch.reset();
+  storage.reset(new array<uint32_t>(int(size), av));
+  scratch.reset(new array_view<uint32_t>(*storage));
+  capacity = size;
+}
+
+void radix_sorter::attach(array_view<uint32_t> scratch) {
+  storage.reset();
+  this->scratch.reset(new array_view<uint32_t>(scratch));
+  capacity = scratch.extent.size();
+  attached = true;
+}
+
+void radix_sorter::trim() {
+  scratch.reset();
+  storage.reset();
+  capacity = 0;
+  attached = false;
 }
+
+void radix_sorter::sort(accelerator_view & av, array_view<uint32_t> key, array_view<uint32_t> index,
+  bool descending /*= false*/, bool is_signed /*= false*/, bool is_float /*= false*/,
+  uint32_t bits_per_pass /*= 8*/, bool is_64bit /*= false*/, uint32_t value_words /*= 1*/) {
+  if (value_words < 1 || value_words > MAX_VALUE_WORDS)
+    throw runtime_exception("radix_sort: unsupported value size", E_INVALIDARG);
+  bits_per_pass = clamp_bits(bits_per_pass);
+  auto count = key.extent.size() / (is_64bit ? 2 : 1);
+  auto required = scratch_size(count, index.extent.size() != 0, bits_per_pass, is_64bit, value_words);
+  if (attached && required > capacity)
+    throw runtime_exception("radix_sort: scratch is too small", E_INVALIDARG);
+  if (required > capacity) // grow by at least a half to amortize reallocation
+    grow(av, required > capacity + capacity / 2 ? required : capacity + capacity / 2);
+
+  switch (bits_per_pass | (is_64bit ? 0x100 : 0)) {
+#define CASE(bits) \
+  case bits: return ::radix_sort<bits, 1>(av, key, index, *scratch, \
+    descending, is_signed, is_float, value_words); \
+  case bits | 0x100: return ::radix_sort<bits, 2>(av, key, index, *scratch, \
+    descending, is_signed, is_float, value_words);
+  CASE(1) CASE(2) CASE(3) CASE(4) CASE(5) CASE(6) CASE(7) CASE(8) CASE(9) CASE(10) CASE(11)
+#undef CASE
+  }
 }
 
+void radix_sort(concurrency::accelerator_view & av,
+  concurrency::array_view<uint32_t> key, concurrency::array_view<uint32_t> index,
+  bool descending /*= false*/, bool is_signed /*= false*/, bool is_float /*= false*/,
+  uint32_t bits_per_pass /*= 8*/, bool is_64bit /*= false*/, uint32_t value_words /*= 1*/) {
+  static radix_sorter sorter;
+  sorter.sort(av, key, index, descending, is_signed, is_float, bits_per_pass, is_64bit, value_words);
+}
+
+}
+}
@@ -0,0 +1,543 @@
+/*
+Copyright (c) 2016, Oleg Ageev
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "parallel/cpu/primitives/radix-sort.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define BLOCK_SIZE 16384 // minimal count of keys per work group
+#define BITS_PER_PASS 8
+#define RADICES 256      // (1 << BITS_PER_PASS)
+#define RADICES_MASK 0xff // (RADICES - 1)
+#define IN_PLACE_BLOCK 256 // keys the in-place sort moves between buckets at once
+#define IN_PLACE_LEAF 32   // buckets up to this many keys are sorted by insertion
+#define IN_PLACE_TASK 65536 // buckets over this many keys are queued for any thread
+
+#define EACH(i, count) for (auto i = decltype(count)(0); i < count; i++)
+
+namespace {
+
+struct consts { uint32_t shift; uint32_t flip; };
+
+struct blocks_info { size_t count; size_t offset; };
+blocks_info get_blocks_info(size_t n, size_t wg_count, size_t wg_idx) {
+  const auto per_wg = (n + wg_count - 1) / wg_count;
+  const auto offset = std::min(n, per_wg * wg_idx);
+  return blocks_info { std::min(per_wg, n - offset), offset };
+}
+
+template<bool IS_FLOAT>
+uint32_t radix_key(uint32_t key, uint32_t flip) {
+  return IS_FLOAT
+    ? key ^ (uint32_t(-int32_t(key >> 31)) | 0x80000000) ^ flip
+    : key ^ flip;
+}
+
+template<bool IS_FLOAT>
+uint32_t digit(uint32_t key, consts const & c) {
+  return (radix_key<IS_FLOAT>(key, c.flip) >> c.shift) & RADICES_MASK;
+}
+
+// Counts the pairs of neighbour keys of a work group that are out of order and
+// in order, the last key is compared with the first of the next work group.
+template<bool IS_FLOAT>
+void count_pairs(size_t wg_idx, size_t wg_count, uint32_t flip, uint32_t const * key, size_t n, size_t * pairs) {
+  const auto blocks = get_blocks_info(n, wg_count, wg_idx);
+  const auto end = std::min(blocks.offset + blocks.count, n - 1);
+  size_t unsorted = 0;
+  for (auto i = blocks.offset; i < end; i++)
+    unsorted += radix_key<IS_FLOAT>(key[i], flip) > radix_key<IS_FLOAT>(key[i + 1], flip);
+  pairs[wg_idx * 2 + 0] = unsorted;
+  pairs[wg_idx * 2 + 1] = (end > blocks.offset ? end - blocks.offset : 0) - unsorted;
+}
+
+// Swaps the keys and values of a range of the first half with the mirrored ones.
+void reverse(size_t wg_idx, size_t wg_count, uint32_t * key, uint32_t * index, size_t n) {
+  const auto blocks = get_blocks_info(n / 2, wg_count, wg_idx);
+  const auto end = blocks.offset + blocks.count;
+  for (auto i = blocks.offset; i < end; i++) {
+    std::swap(key[i], key[n - 1 - i]);
+    if (index != nullptr) std::swap(index[i], index[n - 1 - i]);
+  }
+}
+
+template<bool IS_FLOAT>
+void histogram_count(size_t wg_idx, size_t wg_count, consts const & c,
+  uint32_t const * key, size_t n, size_t * histogram) {
+  size_t local_histogram[RADICES] = { 0 };
+  const auto blocks = get_blocks_info(n, wg_count, wg_idx);
+  auto data = key + blocks.offset;
+  EACH(i, blocks.count) local_histogram[digit<IS_FLOAT>(data[i], c)]++;
+  EACH(d, RADICES) histogram[d * wg_count + wg_idx] = local_histogram[d];
+}
+
+// Exclusive scan of the digit counts of every work group, one range of digits
+// per work group, totals of each digit go to the sums.
+void prefix_scan(size_t wg_idx, size_t wg_count, size_t * histogram, size_t * sums) {
+  const auto digits = get_blocks_info(RADICES, wg_count, wg_idx);
+  EACH(i, digits.count) {
+    const auto d = digits.offset + i;
+    size_t sum = 0;
+    EACH(w, wg_count) {
+      const auto tmp = histogram[d * wg_count + w];
+      histogram[d * wg_count + w] = sum;
+      sum += tmp;
+    }
+    sums[d] = sum;
+  }
+}
+
+template<bool IS_FLOAT>
+void permute(size_t wg_idx, size_t wg_count, consts const & c,
+  uint32_t const * key_in, uint32_t const * index_in,
+  uint32_t * key_out, uint32_t * index_out, size_t n,
+  size_t const * histogram, size_t const * sums) {
+  size_t offset[RADICES];
+  EACH(d, RADICES) offset[d] = sums[d] + histogram[d * wg_count + wg_idx];
+  const auto blocks = get_blocks_info(n, wg_count, wg_idx);
+  const auto end = blocks.offset + blocks.count;
+  if (index_in == nullptr) {
+    for (auto i = blocks.offset; i < end; i++) {
+      const auto k = key_in[i];
+      key_out[offset[digit<IS_FLOAT>(k, c)]++] = k;
+    }
+  } else {
+    for (auto i = blocks.offset; i < end; i++) {
+      const auto k = key_in[i];
+      const auto o = offset[digit<IS_FLOAT>(k, c)]++;
+      key_out[o] = k;
+      index_out[o] = index_in[i];
+    }
+  }
+}
+
+// Sorted keys are left as they are and strictly descending ones reversed,
+// false for keys with equal neighbours, which are sorted to keep them stable.
+template<bool IS_FLOAT>
+bool presorted(parallel::cpu::thread_pool & pool, size_t wg_count, uint32_t * key, size_t n, uint32_t * index,
+  uint32_t flip) {
+  std::vector<size_t> pairs(2 * wg_count);
+  pool.run(wg_count, [&](size_t wg_idx) {
+    count_pairs<IS_FLOAT>(wg_idx, wg_count, flip, key, n, pairs.data());
+  });
+  size_t unsorted = 0, sorted = 0;
+  EACH(w, wg_count) { unsorted += pairs[w * 2 + 0]; sorted += pairs[w * 2 + 1]; }
+  if (unsorted == 0) return true;
+  if (sorted != 0) return false;
+  pool.run(wg_count, [&](size_t wg_idx) { reverse(wg_idx, wg_count, key, index, n); });
+  return true;
+}
+
+template<bool IS_FLOAT>
+void radix_sort(parallel::cpu::thread_pool & pool, uint32_t * key, size_t n, uint32_t * index, uint32_t flip) {
+  const auto wg_count = std::max<size_t>(1, std::min(pool.size(), n / BLOCK_SIZE));
+  if (presorted<IS_FLOAT>(pool, wg_count, key, n, index, flip)) return;
+
+  std::vector<size_t> histogram(RADICES * wg_count);
+  std::vector<size_t> sums(RADICES);
+  std::vector<uint32_t> key_out(n);
+  std::vector<uint32_t> index_out(index == nullptr ? 0 : n);
+
+  uint32_t * data[] = { key, key_out.data(), index, index == nullptr ? nullptr : index_out.data() };
+  for (uint32_t shift = 0; shift < 32; shift += BITS_PER_PASS) {
+    const consts c { shift, flip };
+    pool.run(wg_count, [&](size_t wg_idx) {
+      histogram_count<IS_FLOAT>(wg_idx, wg_count, c, data[0], n, histogram.data());
+    });
+    pool.run(wg_count, [&](size_t wg_idx) {
+      prefix_scan(wg_idx, wg_count, histogram.data(), sums.data());
+    });
+    size_t sum = 0;
+    EACH(d, RADICES) { const auto tmp = sums[d]; sums[d] = sum; sum += tmp; }
+    pool.run(wg_count, [&](size_t wg_idx) {
+      permute<IS_FLOAT>(wg_idx, wg_count, c, data[0], data[2], data[1], data[3], n,
+        histogram.data(), sums.data());
+    });
+    std::swap(data[0], data[1]);
+    std::swap(data[2], data[3]);
+  }
+}
+
+uint32_t * at(uint32_t * data, size_t offset) { return data == nullptr ? nullptr : data + offset; }
+
+// Copies count keys and their values, values is null for keys only.
+void copy_keys(uint32_t * key_to, uint32_t * index_to, uint32_t const * key_from, uint32_t const * index_from,
+  size_t count) {
+  std::copy(key_from, key_from + count, key_to);
+  if (index_to != nullptr) std::copy(index_from, index_from + count, index_to);
+}
+
+template<bool IS_FLOAT>
+void insertion_sort(uint32_t * key, uint32_t * index, size_t begin, size_t end, uint32_t flip) {
+  for (auto i = begin + 1; i < end; i++) {
+    const auto k = key[i];
+    const auto v = index != nullptr ? index[i] : 0;
+    const auto ordered = radix_key<IS_FLOAT>(k, flip);
+    auto j = i;
+    for (; j > begin && radix_key<IS_FLOAT>(key[j - 1], flip) > ordered; j--) {
+      key[j] = key[j - 1];
+      if (index != nullptr) index[j] = index[j - 1];
+    }
+    key[j] = k;
+    if (index != nullptr) index[j] = v;
+  }
+}
+
+// American flag partition of [begin, end) by the digit at c.shift, every key
+// is swapped straight to the next free place of its bucket.
+template<bool IS_FLOAT>
+void flag_partition(uint32_t * key, uint32_t * index, size_t begin, size_t end, consts const & c, size_t * bounds) {
+  size_t next[RADICES] = { 0 };
+  for (auto i = begin; i < end; i++) next[digit<IS_FLOAT>(key[i], c)]++;
+  bounds[0] = begin;
+  EACH(d, RADICES) {
+    bounds[d + 1] = bounds[d] + next[d];
+    next[d] = bounds[d];
+  }
+  EACH(d, RADICES) {
+    while (next[d] < bounds[d + 1]) {
+      auto k = key[next[d]];
+      auto v = index != nullptr ? index[next[d]] : 0;
+      for (auto to = digit<IS_FLOAT>(k, c); to != uint32_t(d); to = digit<IS_FLOAT>(k, c)) {
+        std::swap(k, key[next[to]]);
+        if (index != nullptr) std::swap(v, index[next[to]]);
+        next[to]++;
+      }
+      key[next[d]] = k;
+      if (index != nullptr) index[next[d]] = v;
+      next[d]++;
+    }
+  }
+}
+
+// Distributes keys to buckets in place by all threads in three steps. Every
+// thread collects the keys of its stripe in a block buffer per bucket and
+// writes full blocks back to the start of the stripe. The blocks are then
+// permuted to the regions of their buckets, block aligned, with a lock per
+// bucket region. Finally the buffered keys, and the ones of the blocks that
+// end past their bucket, fill the rest of every bucket.
+template<bool IS_FLOAT>
+struct block_distribution {
+  struct thread_state {
+    size_t fill[RADICES];  // keys in the buffer of every bucket
+    size_t count[RADICES]; // keys of every bucket in the stripe
+    size_t blocks;         // full blocks written back to the stripe
+  };
+
+  std::vector<thread_state> threads;
+  // a buffer per bucket and two blocks to swap for each thread, the block
+  // past the end of the keys and the keys past the end of every bucket
+  std::vector<uint32_t> buffer_key, buffer_index;
+  std::mutex locks[RADICES];
+  size_t region[RADICES], write[RADICES], read[RADICES], spill[RADICES];
+  size_t stripe_blocks;
+  bool overflow;
+
+  block_distribution(size_t thread_count, bool with_index)
+    : threads(thread_count)
+    , buffer_key(buffer_size(thread_count))
+    , buffer_index(with_index ? buffer_size(thread_count) : 0) {}
+
+  static size_t buffer_size(size_t thread_count) {
+    return (thread_count * (RADICES + 2) + 1 + RADICES) * IN_PLACE_BLOCK;
+  }
+  size_t bucket_buffer(size_t wg_idx, size_t d) const { return (wg_idx * (RADICES + 2) + d) * IN_PLACE_BLOCK; }
+  size_t overflow_buffer() const { return threads.size() * (RADICES + 2) * IN_PLACE_BLOCK; }
+  size_t spill_buffer(size_t d) const { return overflow_buffer() + (1 + d) * IN_PLACE_BLOCK; }
+  uint32_t * buffer_values(size_t offset) { return buffer_index.empty() ? nullptr : buffer_index.data() + offset; }
+
+  // block holds keys of the stripe that were written back, not yet moved
+  bool filled(size_t block) const {
+    return block % stripe_blocks < threads[block / stripe_blocks].blocks;
+  }
+
+  void run(parallel::cpu::thread_pool & pool, size_t wg_count, uint32_t * key, uint32_t * index, size_t n,
+    consts const & c, size_t * bounds) {
+    const auto blocks = (n + IN_PLACE_BLOCK - 1) / IN_PLACE_BLOCK;
+    stripe_blocks = (blocks + wg_count - 1) / wg_count;
+    overflow = false;
+    pool.run(wg_count, [&](size_t wg_idx) { classify(wg_idx, wg_count, blocks, key, index, n, c); });
+
+    bounds[0] = 0;
+    EACH(d, RADICES) {
+      size_t total = 0;
+      EACH(w, wg_count) total += threads[w].count[d];
+      bounds[d + 1] = bounds[d] + total;
+      region[d] = write[d] = (bounds[d] + IN_PLACE_BLOCK - 1) / IN_PLACE_BLOCK;
+      read[d] = (bounds[d + 1] + IN_PLACE_BLOCK - 1) / IN_PLACE_BLOCK;
+    }
+    pool.run(wg_count, [&](size_t wg_idx) { permute_blocks(wg_idx, wg_count, key, index, n, c); });
+
+    // the last block was only written whole to the overflow buffer
+    const auto last = (blocks - 1) * IN_PLACE_BLOCK;
+    if (overflow)
+      copy_keys(key + last, at(index, last), buffer_key.data() + overflow_buffer(),
+        buffer_values(overflow_buffer()), n - last);
+    pool.run(wg_count, [&](size_t wg_idx) {
+      const auto digits = get_blocks_info(RADICES, wg_count, wg_idx);
+      EACH(i, digits.count) save_spill(digits.offset + i, key, index, n, last, bounds);
+    });
+    pool.run(wg_count, [&](size_t wg_idx) {
+      const auto digits = get_blocks_info(RADICES, wg_count, wg_idx);
+      EACH(i, digits.count) fill_bucket(digits.offset + i, wg_count, key, index, bounds);
+    });
+  }
+
+  void classify(size_t wg_idx, size_t wg_count, size_t blocks, uint32_t * key, uint32_t * index, size_t n,
+    consts const & c) {
+    auto & state = threads[wg_idx];
+    std::fill(state.fill, state.fill + RADICES, 0);
+    std::fill(state.count, state.count + RADICES, 0);
+    state.blocks = 0;
+    const auto stripe = get_blocks_info(blocks, wg_count, wg_idx);
+    const auto first = stripe.offset * IN_PLACE_BLOCK;
+    const auto end = std::min(n, (stripe.offset + stripe.count) * IN_PLACE_BLOCK);
+    for (auto i = first; i < end; i++) {
+      const auto d = digit<IS_FLOAT>(key[i], c);
+      const auto buffer = bucket_buffer(wg_idx, d);
+      state.count[d]++;
+      buffer_key[buffer + state.fill[d]] = key[i];
+      if (index != nullptr) buffer_index[buffer + state.fill[d]] = index[i];
+      if (++state.fill[d] < IN_PLACE_BLOCK) continue;
+      // the stripe has been read past every block written back
+      const auto to = first + state.blocks++ * IN_PLACE_BLOCK;
+      copy_keys(key + to, at(index, to), buffer_key.data() + buffer, buffer_values(buffer), IN_PLACE_BLOCK);
+      state.fill[d] = 0;
+    }
+  }
+
+  // Takes blocks from the regions still holding unmoved ones and carries each
+  // to the next free place of its bucket, swapping it with the unmoved block
+  // found there. Blocks of a region are only touched under its lock.
+  void permute_blocks(size_t wg_idx, size_t wg_count, uint32_t * key, uint32_t * index, size_t n,
+    consts const & c) {
+    auto carry = bucket_buffer(wg_idx, RADICES), spare = bucket_buffer(wg_idx, RADICES + 1);
+    EACH(j, RADICES) {
+      const auto i = (j + wg_idx * RADICES / wg_count) % RADICES;
+      for (;;) {
+        {
+          std::lock_guard<std::mutex> lock(locks[i]);
+          while (read[i] > write[i] && !filled(read[i] - 1)) read[i]--;
+          if (read[i] <= write[i]) break;
+          const auto from = --read[i] * IN_PLACE_BLOCK;
+          copy_keys(buffer_key.data() + carry, buffer_values(carry), key + from, at(index, from), IN_PLACE_BLOCK);
+        }
+        for (auto placed = false; !placed;) {
+          const auto d = digit<IS_FLOAT>(buffer_key[carry], c);
+          std::lock_guard<std::mutex> lock(locks[d]);
+          const auto block = write[d]++;
+          const auto to = block * IN_PLACE_BLOCK;
+          placed = block >= read[d] || !filled(block);
+          if (!placed) {
+            copy_keys(buffer_key.data() + spare, buffer_values(spare), key + to, at(index, to), IN_PLACE_BLOCK);
+            copy_keys(key + to, at(index, to), buffer_key.data() + carry, buffer_values(carry), IN_PLACE_BLOCK);
+            std::swap(carry, spare);
+          } else if (to + IN_PLACE_BLOCK > n) {
+            copy_keys(buffer_key.data() + overflow_buffer(), buffer_values(overflow_buffer()),
+              buffer_key.data() + carry, buffer_values(carry), IN_PLACE_BLOCK);
+            overflow = true;
+          } else {
+            copy_keys(key + to, at(index, to), buffer_key.data() + carry, buffer_values(carry), IN_PLACE_BLOCK);
+          }
+        }
+      }
+    }
+  }
+
+  // end of the blocks moved to the region of bucket d
+  size_t blocks_end(size_t d) const { return write[d] * IN_PLACE_BLOCK; }
+
+  // Keeps the keys of the blocks of bucket d past its end, they are in the
+  // place of the first keys of the next bucket.
+  void save_spill(size_t d, uint32_t const * key, uint32_t const * index, size_t n, size_t last,
+    size_t const * bounds) {
+    const auto end = blocks_end(d);
+    const auto count = write[d] > region[d] && end > bounds[d + 1] ? end - bounds[d + 1] : 0;
+    spill[d] = count;
+    EACH(i, count) {
+      const auto from = bounds[d + 1] + i;
+      const auto to = spill_buffer(d) + i;
+      const auto source = from < n ? from : overflow_buffer() + from - last;
+      buffer_key[to] = from < n ? key[source] : buffer_key[source];
+      if (index != nullptr) buffer_index[to] = from < n ? index[source] : buffer_index[source];
+    }
+  }
+
+  // Fills the places of bucket d before and after its blocks with its spilled
+  // and buffered keys.
+  void fill_bucket(size_t d, size_t wg_count, uint32_t * key, uint32_t * index, size_t const * bounds) {
+    const auto end = bounds[d + 1];
+    const auto head_end = std::min(region[d] * IN_PLACE_BLOCK, end);
+    const auto tail = std::max(blocks_end(d), head_end);
+    auto to = bounds[d];
+    auto put = [&](uint32_t const * key_from, uint32_t const * index_from, size_t count) {
+      while (count > 0) {
+        if (to == head_end) to = tail;
+        const auto moved = std::min(count, (to < head_end ? head_end : end) - to);
+        copy_keys(key + to, at(index, to), key_from, index_from, moved);
+        to += moved;
+        key_from += moved;
+        if (index_from != nullptr) index_from += moved;
+        count -= moved;
+      }
+    };
+    put(buffer_key.data() + spill_buffer(d), buffer_values(spill_buffer(d)), spill[d]);
+    EACH(w, wg_count)
+      put(buffer_key.data() + bucket_buffer(w, d), buffer_values(bucket_buffer(w, d)), threads[w].fill[d]);
+  }
+};
+
+struct in_place_task { size_t begin, end; uint32_t shift; };
+
+// Buckets any thread may take, sorting stops once none is queued and none
+// is being sorted, as a bucket being sorted may queue more. Idle threads
+// sleep until either happens.
+struct task_queue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<in_place_task> tasks;
+  size_t active = 0;
+
+  void push(in_place_task const & task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(task);
+    }
+    changed.notify_one();
+  }
+  // Takes a bucket to sort, false once sorting stopped.
+  bool pop(in_place_task & task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return !tasks.empty() || active == 0; });
+    if (tasks.empty()) return false;
+    task = tasks.back();
+    tasks.pop_back();
+    active++;
+    return true;
+  }
+  void done() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (--active == 0 && tasks.empty()) {
+      lock.unlock();
+      changed.notify_all();
+    }
+  }
+};
+
+// Sorts a bucket by the rest of its digits on one thread, depth first, and
+// queues the sub-buckets large enough to be worth sorting on another one.
+template<bool IS_FLOAT>
+void sort_bucket(task_queue & queue, uint32_t * key, uint32_t * index, uint32_t flip, in_place_task const & task) {
+  std::vector<in_place_task> stack { task };
+  while (!stack.empty()) {
+    const auto bucket = stack.back();
+    stack.pop_back();
+    if (bucket.end - bucket.begin <= IN_PLACE_LEAF) {
+      insertion_sort<IS_FLOAT>(key, index, bucket.begin, bucket.end, flip);
+      continue;
+    }
+    size_t bounds[RADICES + 1];
+    flag_partition<IS_FLOAT>(key, index, bucket.begin, bucket.end, consts { bucket.shift, flip }, bounds);
+    if (bucket.shift == 0) continue;
+    EACH(d, RADICES) {
+      const in_place_task sub { bounds[d], bounds[d + 1], bucket.shift - BITS_PER_PASS };
+      if (sub.end - sub.begin < 2) continue;
+      if (sub.end - sub.begin > IN_PLACE_TASK) queue.push(sub);
+      else stack.push_back(sub);
+    }
+  }
+}
+
+// Distributes by the top digits with every thread while a bucket is larger
+// than a thread's share of the keys, then sorts the buckets on whichever
+// thread is free.
+template<bool IS_FLOAT>
+void radix_sort_in_place(parallel::cpu::thread_pool & pool, uint32_t * key, size_t n, uint32_t * index,
+  uint32_t flip) {
+  const auto wg_count = std::max<size_t>(1, std::min(pool.size(), n / BLOCK_SIZE));
+  if (presorted<IS_FLOAT>(pool, wg_count, key, n, index, flip)) return;
+
+  task_queue queue;
+  std::unique_ptr<block_distribution<IS_FLOAT>> distribution;
+  std::vector<in_place_task> large { { 0, n, 32 - BITS_PER_PASS } };
+  while (!large.empty()) {
+    const auto task = large.back();
+    large.pop_back();
+    const auto count = task.end - task.begin;
+    const auto threads = std::min(pool.size(), count / BLOCK_SIZE);
+    if (threads < 2 || count <= n / pool.size()) {
+      queue.tasks.push_back(task);
+      continue;
+    }
+    if (!distribution) distribution.reset(new block_distribution<IS_FLOAT>(pool.size(), index != nullptr));
+    size_t bounds[RADICES + 1];
+    distribution->run(pool, threads, key + task.begin, at(index, task.begin), count, consts { task.shift, flip },
+      bounds);
+    if (task.shift == 0) continue;
+    EACH(d, RADICES) {
+      const in_place_task bucket { task.begin + bounds[d], task.begin + bounds[d + 1], task.shift - BITS_PER_PASS };
+      if (bucket.end - bucket.begin > 1) large.push_back(bucket);
+    }
+  }
+
+  pool.run(pool.size(), [&](size_t) {
+    in_place_task task;
+    while (queue.pop(task)) {
+      sort_bucket<IS_FLOAT>(queue, key, index, flip, task);
+      queue.done();
+    }
+  });
+}
+
+}
+
+namespace parallel {
+namespace cpu {
+
+void radix_sort(thread_pool & pool, uint32_t * key, size_t size, uint32_t * index /*= nullptr*/,
+  bool descending /*= false*/, bool is_signed /*= false*/, bool is_float /*= false*/) {
+  const uint32_t flip = (descending ? 0xffffffff : 0) ^ (is_signed && !is_float ? 0x80000000 : 0);
+  if (is_float)
+    ::radix_sort<true>(pool, key, size, index, flip);
+  else
+    ::radix_sort<false>(pool, key, size, index, flip);
+}
+
+void radix_sort_in_place(thread_pool & pool, uint32_t * key, size_t size, uint32_t * index /*= nullptr*/,
+  bool descending /*= false*/, bool is_signed /*= false*/, bool is_float /*= false*/) {
+  const uint32_t flip = (descending ? 0xffffffff : 0) ^ (is_signed && !is_float ? 0x80000000 : 0);
+  if (is_float)
+    ::radix_sort_in_place<true>(pool, key, size, index, flip);
+  else
+    ::radix_sort_in_place<false>(pool, key, size, index, flip);
+}
+
+}
+}
@@ -0,0 +1,69 @@
+#include "parallel/cpu/thread-pool.hh"
+
+namespace parallel {
+namespace cpu {
+
+thread_pool::thread_pool(size_t threads /*= std::thread::hardware_concurrency()*/) {
+  for (size_t i = 1; i < threads; i++)
+    workers.emplace_back([this] { work(); });
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  wake.notify_all();
+  for (auto & worker : workers) worker.join();
+}
+
+thread_pool & thread_pool::instance() {
+  static thread_pool pool;
+  return pool;
+}
+
+void thread_pool::run(size_t count, std::function<void(size_t)> const & f) {
+  if (count == 0) return;
+  if (count == 1 || workers.empty()) {
+    for (size_t i = 0; i < count; i++) f(i);
+    return;
+  }
+  std::lock_guard<std::mutex> serial(running);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &f;
+    job_count = count;
+    next = 0;
+    pending = workers.size();
+    generation++;
+  }
+  wake.notify_all();
+  drain();
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this] { return pending == 0; });
+  job = nullptr;
+}
+
+void thread_pool::drain() {
+  for (auto i = next++; i < job_count; i = next++) (*job)(i);
+}
+
+void thread_pool::work() {
+  size_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this, seen] { return stop || generation != seen; });
+      if (stop) return;
+      seen = generation;
+    }
+    drain();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending == 0) done.notify_one();
+    }
+  }
+}
+
+}
+}
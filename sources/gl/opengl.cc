@@ -1,6 +1,17 @@
 #include "parallel/gl/opengl.hh"
 
+#if !defined(PARALLEL_GL_EGL)
 #include <GL/wglext.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace parallel {
 namespace gl {
@@ -9,18 +20,459 @@ static GL gl;
 
 GL & GL::instance() { return gl; }
 
-static PIXELFORMATDESCRIPTOR pfd = { 0 };
-GL & GL::initialize(HDC device, GLDEBUGPROC debug_message_callback, bool debug /*= false*/) {
-  static char const * names[] = {
+static char const * names[] = {
 #define FUNCTION(name, NAME) "gl" # name,
-    GL_FUNCTIONS(FUNCTION)
+  GL_FUNCTIONS(FUNCTION)
 #undef FUNCTION
-    nullptr
+  nullptr
+};
+
+static char const * dsa_names[] = {
+#define FUNCTION(name, NAME) "gl" # name,
+  GL_DSA_FUNCTIONS(FUNCTION)
+#undef FUNCTION
+  nullptr
+};
+
+#ifndef GL_KHR_shader_subgroup
+#define GL_SUBGROUP_SUPPORTED_STAGES_KHR       0x9533
+#define GL_SUBGROUP_SUPPORTED_FEATURES_KHR     0x9534
+#define GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR 0x00000004
+#endif
+
+static bool has_gl_extension(GL const & gl, char const * name) {
+  auto count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (auto i = 0; i < count; i++)
+    if (strcmp(reinterpret_cast<char const *>(gl.GetStringi(GL_EXTENSIONS, i)), name) == 0)
+      return true;
+  return false;
+}
+
+static bool has_subgroup_arithmetic(GL const & gl) {
+  if (!has_gl_extension(gl, "GL_KHR_shader_subgroup")) return false;
+  auto stages = 0, features = 0;
+  glGetIntegerv(GL_SUBGROUP_SUPPORTED_STAGES_KHR, &stages);
+  glGetIntegerv(GL_SUBGROUP_SUPPORTED_FEATURES_KHR, &features);
+  return (stages & GL_COMPUTE_SHADER_BIT) && (features & GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR);
+}
+
+// Lets the driver link with as many threads as it likes, programs are then
+// created without waiting and link status queries wait for them.
+template<typename F>
+static bool enable_parallel_compile(GL const & gl, F && get_proc_address) {
+  auto max_threads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSARBPROC>(
+    has_gl_extension(gl, "GL_KHR_parallel_shader_compile") ? get_proc_address("glMaxShaderCompilerThreadsKHR")
+    : has_gl_extension(gl, "GL_ARB_parallel_shader_compile") ? get_proc_address("glMaxShaderCompilerThreadsARB")
+    : nullptr);
+  if (max_threads == nullptr) return false;
+  max_threads(0xffffffff);
+  return true;
+}
+
+// Loads the direct state access entry points, which follow the core ones in
+// GL, or leaves them null so the buffer wrapper binds instead.
+template<typename F>
+static void load_direct_state_access(GL & gl, F && get_proc_address) {
+  auto dsa = has_gl_extension(gl, "GL_ARB_direct_state_access");
+  auto gl_function = reinterpret_cast<void (**)()>(&gl.ClearNamedBufferSubData);
+  for (auto gl_name = dsa_names; *gl_name; gl_name++)
+    *gl_function++ = dsa ? reinterpret_cast<void (*)()>(get_proc_address(*gl_name)) : nullptr;
+}
+
+// FNV-1a with a zero byte after every string, so that moving text between
+// strings changes the hash.
+static uint64_t hash_string(uint64_t hash, char const * text) {
+  do hash = (hash ^ uint8_t(*text)) * UINT64_C(1099511628211); while (*text++);
+  return hash;
+}
+
+// names the SPIR-V module of the sources, which is the same for every driver
+static uint64_t source_hash(GLenum type, GLsizei count, GLchar const * const * sources) {
+  auto hash = hash_string(UINT64_C(14695981039346656037), std::to_string(type).c_str());
+  for (auto i = 0; i < count; i++) hash = hash_string(hash, sources[i]);
+  return hash;
+}
+
+// names the program binary of the sources linked by this driver
+static uint64_t driver_hash(uint64_t hash) {
+  hash = hash_string(hash, reinterpret_cast<char const *>(glGetString(GL_VENDOR)));
+  hash = hash_string(hash, reinterpret_cast<char const *>(glGetString(GL_RENDERER)));
+  return hash_string(hash, reinterpret_cast<char const *>(glGetString(GL_VERSION)));
+}
+
+static std::string hash_path(char const * directory, uint64_t hash, char const * extension) {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.%s", static_cast<unsigned long long>(hash), extension);
+  return directory + std::string(name);
+}
+
+static bool read_file(std::string const & path, std::vector<char> & data) {
+  auto file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return false;
+  char chunk[4096];
+  for (size_t read; (read = fread(chunk, 1, sizeof(chunk), file)) != 0;)
+    data.insert(data.end(), chunk, chunk + read);
+  fclose(file);
+  return true;
+}
+
+// Writes a temporary file renamed over path. Workers starting together race
+// on it at worst into a file that fails to load and is built again.
+static void write_file(std::string const & path, std::vector<char> const & data) {
+  auto temporary = path + ".tmp";
+  auto file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr) return;
+  auto written = fwrite(data.data(), 1, data.size(), file) == data.size();
+  if (fclose(file) == 0 && written) {
+    remove(path.c_str()); // rename does not replace a file on Windows
+    if (rename(temporary.c_str(), path.c_str()) == 0) return;
+  }
+  remove(temporary.c_str());
+}
+
+struct program_header {
+  uint32_t magic;
+  GLenum format;
+  uint64_t hash;
+};
+
+static uint32_t const program_magic = 0x42504c47; // "GLPB"
+static uint32_t const spirv_magic = 0x07230203;
+
+static bool has_binary_format(GLenum format) {
+  auto count = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+  std::vector<GLint> formats(count);
+  if (count > 0) glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+  for (auto supported : formats)
+    if (GLenum(supported) == format) return true;
+  return false;
+}
+
+// The binary of another driver or a damaged file fails to link, which
+// glProgramBinary reports only by GL_LINK_STATUS.
+static GLuint load_program(GL const & gl, std::string const & path, uint64_t hash) {
+  std::vector<char> data;
+  program_header header;
+  if (!read_file(path, data) || data.size() <= sizeof(header)) return 0;
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != program_magic || header.hash != hash || !has_binary_format(header.format)) return 0;
+
+  auto id = gl.CreateProgram();
+  gl.ProgramParameteri(id, GL_PROGRAM_SEPARABLE, GL_TRUE);
+  gl.ProgramBinary(id, header.format, data.data() + sizeof(header), GLsizei(data.size() - sizeof(header)));
+  auto status = GL_FALSE;
+  gl.GetProgramiv(id, GL_LINK_STATUS, &status);
+  if (status == GL_TRUE) return id;
+  gl.DeleteProgram(id);
+  return 0;
+}
+
+static void save_program(GL const & gl, GLuint id, std::string const & path, uint64_t hash) {
+  auto length = 0;
+  gl.GetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) return;
+  program_header header = { program_magic, 0, hash };
+  std::vector<char> data(sizeof(header) + length);
+  gl.GetProgramBinary(id, length, &length, &header.format, data.data() + sizeof(header));
+  memcpy(data.data(), &header, sizeof(header));
+  write_file(path, data);
+}
+
+static GLuint compiled(GL const & gl, GLuint shader) {
+  auto status = GL_FALSE;
+  gl.GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status == GL_TRUE) return shader;
+  gl.DeleteShader(shader);
+  return 0;
+}
+
+// Specialization constant ids of a module, glslang leaves out the unused ones.
+static std::vector<GLuint> spec_ids(std::vector<uint32_t> const & module) {
+  std::vector<GLuint> ids;
+  for (size_t i = 5; i < module.size() && module[i] >> 16 != 0; i += module[i] >> 16)
+    if (module[i] == (4 << 16 | 71) && i + 3 < module.size() && module[i + 2] == 1) // OpDecorate SpecId
+      ids.push_back(module[i + 3]);
+  return ids;
+}
+
+// A module that is not SPIR-V or fails to specialize leaves the GLSL to compile.
+static GLuint load_module(GL const & gl, GLenum type, std::string const & path,
+                          specialization const & constants) {
+  std::vector<char> data;
+  if (!read_file(path, data) || data.size() < sizeof(uint32_t) || data.size() % sizeof(uint32_t) != 0) return 0;
+  std::vector<uint32_t> module(data.size() / sizeof(uint32_t));
+  memcpy(module.data(), data.data(), data.size());
+  if (module[0] != spirv_magic) return 0;
+  std::vector<GLuint> ids, values;
+  auto declared = spec_ids(module);
+  for (GLuint i = 0; i < constants.count; i++)
+    if (std::find(declared.begin(), declared.end(), constants.ids[i]) != declared.end()) {
+      ids.push_back(constants.ids[i]);
+      values.push_back(constants.values[i]);
+    }
+  auto shader = gl.CreateShader(type);
+  gl.ShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, module.data(), GLsizei(data.size()));
+  gl.SpecializeShader(shader, "main", GLuint(ids.size()), ids.data(), values.data());
+  return compiled(gl, shader);
+}
+
+// Defines CONSTANT_<id> of constants for the GLSL, after its #version line.
+static std::string constant_defines(specialization const & constants) {
+  std::string defines;
+  for (GLuint i = 0; i < constants.count; i++)
+    defines += "#define CONSTANT_" + std::to_string(constants.ids[i]) + " "
+      + std::to_string(constants.values[i]) + "\n";
+  return defines;
+}
+
+// Programs of create_program() whose shader stays attached and whose binary
+// is stored once check_program() sees them linked, by context and name.
+struct linking_program {
+  GLuint shader;
+  std::string binary_path;
+  uint64_t binary_hash;
+};
+static std::map<std::pair<decltype(GL::context), GLuint>, linking_program> linking;
+static std::mutex linking_mutex;
+
+// A program of the name of a deleted one is linked already.
+static GLuint forget_linking(GL const & gl, GLuint id) {
+  std::lock_guard<std::mutex> lock(linking_mutex);
+  linking.erase({ gl.context, id });
+  return id;
+}
+
+std::string module_path(char const * directory, GLenum type, GLsizei count, GLchar const * const * sources) {
+  return hash_path(directory, source_hash(type, count, sources), "spv");
+}
+
+std::string binary_path(GL const & gl, GLenum type, GLsizei count, GLchar const * const * sources,
+                        specialization const & constants /*= specialization { 0, nullptr, nullptr }*/) {
+  auto hash = hash_string(source_hash(type, count, sources), constant_defines(constants).c_str());
+  return hash_path(gl.program_cache, driver_hash(hash), "bin");
+}
+
+GLuint create_program(GL const & gl, GLenum type, GLsizei count, GLchar const * const * sources,
+                      specialization const & constants /*= specialization { 0, nullptr, nullptr }*/) {
+  auto defines = constant_defines(constants);
+  std::vector<GLchar const *> glsl(sources, sources + count);
+  if (count > 0) glsl.insert(glsl.begin() + 1, defines.c_str());
+  auto glsl_count = GLsizei(glsl.size());
+  auto modules = gl.spirv_modules != nullptr && gl.SpecializeShader != nullptr;
+  if (gl.program_cache == nullptr && !modules)
+    return forget_linking(gl, gl.CreateShaderProgramv(type, glsl_count, glsl.data()));
+
+  auto hash = source_hash(type, count, sources);
+  auto binary_hash = gl.program_cache != nullptr ? driver_hash(hash_string(hash, defines.c_str())) : 0;
+  std::string binary_path;
+  if (gl.program_cache != nullptr) {
+    binary_path = hash_path(gl.program_cache, binary_hash, "bin");
+    if (auto id = load_program(gl, binary_path, binary_hash)) return forget_linking(gl, id);
+  }
+
+  GLuint shader = 0;
+  if (modules) shader = load_module(gl, type, hash_path(gl.spirv_modules, hash, "spv"), constants);
+  if (shader == 0) {
+    shader = gl.CreateShader(type);
+    gl.ShaderSource(shader, glsl_count, glsl.data(), nullptr);
+    gl.CompileShader(shader);
+  }
+
+  // glCreateShaderProgramv, with the binary retrievable hint set before
+  // linking and the shader attached until the program is checked
+  auto id = gl.CreateProgram();
+  gl.ProgramParameteri(id, GL_PROGRAM_SEPARABLE, GL_TRUE);
+  if (gl.program_cache != nullptr) gl.ProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  gl.AttachShader(id, shader);
+  gl.LinkProgram(id);
+  gl.DeleteShader(shader); // goes with its detach or the program
+  std::lock_guard<std::mutex> lock(linking_mutex);
+  linking[{ gl.context, id }] = linking_program { shader, binary_path, binary_hash };
+  return id;
+}
+
+void check_program(GL const & gl, GLuint id) {
+  linking_program program = { 0, std::string(), 0 };
+  {
+    std::lock_guard<std::mutex> lock(linking_mutex);
+    auto it = linking.find({ gl.context, id });
+    if (it != linking.end()) {
+      program = it->second;
+      linking.erase(it);
+    }
+  }
+  auto status = GL_TRUE;
+  gl.GetProgramiv(id, GL_LINK_STATUS, &status);
+  if (GL_TRUE != status) {
+    char info[1024];
+    auto compiled = GL_TRUE;
+    if (program.shader != 0) gl.GetShaderiv(program.shader, GL_COMPILE_STATUS, &compiled);
+    if (GL_TRUE != compiled) gl.GetShaderInfoLog(program.shader, sizeof(info), nullptr, info);
+    else gl.GetProgramInfoLog(id, sizeof(info), nullptr, info);
+    gl.DebugMessageInsert(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_ERROR,
+      GL_LINK_STATUS, GL_DEBUG_SEVERITY_HIGH, -1, info);
+  }
+  if (program.shader == 0) return;
+  gl.DetachShader(id, program.shader);
+  if (GL_TRUE == status && !program.binary_path.empty())
+    save_program(gl, id, program.binary_path, program.binary_hash);
+}
+
+#if defined(PARALLEL_GL_EGL)
+
+// One display for every context, terminated when the last of them goes.
+static EGLDisplay display = EGL_NO_DISPLAY;
+static unsigned display_contexts = 0;
+static std::mutex display_mutex;
+
+static bool has_extension(char const * extensions, char const * name) {
+  auto length = strlen(name);
+  for (auto it = extensions; it && (it = strstr(it, name)); it += length)
+    if ((it == extensions || it[-1] == ' ') && (it[length] == ' ' || it[length] == '\0'))
+      return true;
+  return false;
+}
+
+static EGLDisplay get_display() {
+  auto extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  auto eglGetPlatformDisplayEXT
+    = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (eglGetPlatformDisplayEXT == nullptr)
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  if (has_extension(extensions, "EGL_MESA_platform_surfaceless")) {
+    auto display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr))
+      return display;
+  }
+
+  if (has_extension(extensions, "EGL_EXT_platform_device")) {
+    auto eglQueryDevicesEXT
+      = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+    EGLDeviceEXT devices[16];
+    EGLint count = 0;
+    if (eglQueryDevicesEXT != nullptr)
+      eglQueryDevicesEXT(ARRAYSIZE(devices), devices, &count);
+    for (EGLint i = 0; i < count; i++) {
+      auto display = eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, devices[i], nullptr);
+      if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr))
+        return display;
+    }
+  }
+
+  auto display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  return display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr) ? display : EGL_NO_DISPLAY;
+}
+
+// A context without EGL_KHR_no_config_context takes the config of a pbuffer,
+// which it is made current on.
+static EGLConfig get_config(EGLDisplay display) {
+  if (has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_no_config_context"))
+    return EGL_NO_CONFIG_KHR;
+  EGLint attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
   };
+  EGLConfig config = EGL_NO_CONFIG_KHR;
+  EGLint count = 0;
+  return eglChooseConfig(display, attribs, &config, 1, &count) && count == 1 ? config : EGL_NO_CONFIG_KHR;
+}
 
+GL & GL::initialize(GLDEBUGPROC debug_message_callback, bool debug /*= false*/,
+                    GL const * share /*= nullptr*/) {
+  std::unique_lock<std::mutex> lock(display_mutex);
+  if (display == EGL_NO_DISPLAY)
+    display = get_display(); // initialized once for every context
+  context = EGL_NO_CONTEXT;
+  surface = EGL_NO_SURFACE;
+  if (display != EGL_NO_DISPLAY && eglBindAPI(EGL_OPENGL_API)) {
+    auto config = get_config(display);
+    EGLint attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 4,
+      EGL_CONTEXT_MINOR_VERSION, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_CONTEXT_OPENGL_DEBUG, debug ? EGL_TRUE : EGL_FALSE,
+      EGL_NONE
+    };
+    EGLint surface_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    if (config != EGL_NO_CONFIG_KHR)
+      surface = eglCreatePbufferSurface(display, config, surface_attribs);
+    context = eglCreateContext(display, config,
+      share != nullptr ? share->context : EGL_NO_CONTEXT, attribs);
+  }
+  if (context == EGL_NO_CONTEXT && surface != EGL_NO_SURFACE) {
+    eglDestroySurface(display, surface);
+    surface = EGL_NO_SURFACE;
+  }
+  if (context != EGL_NO_CONTEXT)
+    display_contexts++;
+  else if (display != EGL_NO_DISPLAY && display_contexts == 0) {
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+  }
+  lock.unlock();
+
+  if (context == EGL_NO_CONTEXT
+      || !eglMakeCurrent(display, surface, surface, context)) {
+    if (debug_message_callback != nullptr)
+      debug_message_callback(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_ERROR,
+        GL_VERSION, GL_DEBUG_SEVERITY_HIGH, -1, "OpenGL 4.3 Required", nullptr);
+    return *this;
+  }
+
+  if (debug)
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+  auto gl_name = names;
+  auto gl_function = reinterpret_cast<__eglMustCastToProperFunctionPointerType *>(this);
+  while (*gl_name) *gl_function++ = eglGetProcAddress(*gl_name++);
+
+  if(debug_message_callback != nullptr)
+    this->DebugMessageCallback(debug_message_callback, nullptr);
+  forget_bindings();
+
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &this->alignment);
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &this->storage_alignment);
+  this->subgroup_arithmetic = has_subgroup_arithmetic(*this);
+  this->parallel_compile = enable_parallel_compile(*this, eglGetProcAddress);
+  load_direct_state_access(*this, eglGetProcAddress);
+  this->SpecializeShader = has_gl_extension(*this, "GL_ARB_gl_spirv")
+    ? reinterpret_cast<PFNGLSPECIALIZESHADERARBPROC>(eglGetProcAddress("glSpecializeShaderARB")) : nullptr;
+
+  return *this;
+}
+
+void GL::deinitialize() {
+  if (context == EGL_NO_CONTEXT)
+    return;
+  if (eglGetCurrentContext() == context)
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  std::lock_guard<std::mutex> lock(display_mutex);
+  eglDestroyContext(display, context);
+  context = EGL_NO_CONTEXT;
+  if (surface != EGL_NO_SURFACE)
+    eglDestroySurface(display, surface);
+  surface = EGL_NO_SURFACE;
+  if (--display_contexts == 0) {
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+  }
+}
+
+#else
+
+static PIXELFORMATDESCRIPTOR pfd = { 0 };
+GL & GL::initialize(HDC device, GLDEBUGPROC debug_message_callback, bool debug /*= false*/,
+                    GL const * share /*= nullptr*/) {
   pfd.dwFlags = PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
   SetPixelFormat(device, ChoosePixelFormat(device, &pfd), &pfd);
-  wglMakeCurrent(device, wglCreateContext(device));
+  context = wglCreateContext(device);
+  if (share != nullptr && !debug)
+    wglShareLists(share->context, context);
+  wglMakeCurrent(device, context);
 
   auto major = 0, minor = 0;
   glGetIntegerv(GL_MAJOR_VERSION, &major);
@@ -33,9 +485,10 @@ GL & GL::initialize(HDC device, GLDEBUGPROC debug_message_callback, bool debug /
     auto wglCreateContextAttribsARB
       = reinterpret_cast<PFNWGLCREATECONTEXTATTRIBSARBPROC>(wglGetProcAddress("wglCreateContextAttribsARB"));
     GLint attribs[] = { WGL_CONTEXT_FLAGS_ARB, WGL_CONTEXT_DEBUG_BIT_ARB, 0 };
-    auto context = wglGetCurrentContext();
-    wglMakeCurrent(device, wglCreateContextAttribsARB(device, nullptr, attribs));
-    wglDeleteContext(context);
+    auto legacy = context;
+    context = wglCreateContextAttribsARB(device, share != nullptr ? share->context : nullptr, attribs);
+    wglMakeCurrent(device, context);
+    wglDeleteContext(legacy);
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
   }
 
@@ -45,19 +498,32 @@ GL & GL::initialize(HDC device, GLDEBUGPROC debug_message_callback, bool debug /
 
   if(debug_message_callback != nullptr)
     this->DebugMessageCallback(debug_message_callback, nullptr);
+  forget_bindings();
 
   glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &this->alignment);
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &this->storage_alignment);
+  this->subgroup_arithmetic = has_subgroup_arithmetic(*this);
+  this->parallel_compile = enable_parallel_compile(*this, wglGetProcAddress);
+  load_direct_state_access(*this, wglGetProcAddress);
+  this->SpecializeShader = has_gl_extension(*this, "GL_ARB_gl_spirv")
+    ? reinterpret_cast<PFNGLSPECIALIZESHADERARBPROC>(wglGetProcAddress("glSpecializeShaderARB")) : nullptr;
 
   return *this;
 }
 
 void GL::deinitialize() {
-  auto context = wglGetCurrentContext();
-  auto device = wglGetCurrentDC();
-  wglMakeCurrent(nullptr, nullptr);
+  if (context == nullptr)
+    return;
+  auto device = wglGetCurrentContext() == context ? wglGetCurrentDC() : nullptr;
+  if (device != nullptr)
+    wglMakeCurrent(nullptr, nullptr);
   wglDeleteContext(context);
-  DeleteDC(device);
+  context = nullptr;
+  if (device != nullptr)
+    DeleteDC(device);
 }
 
+#endif
+
 }
 }
@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <cstdlib>
 #include <cstdint>
 #include <cinttypes>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <random>
 #include <sstream>
+#include <vector>
 
 #include <parallel/amp/primitives/radix-sort.hh>
 
@@ -29,6 +33,161 @@ uint64_t timed(F && f) {
   return ticks() - start;
 };
 
+void report(char const * name, bool passed) {
+  std::cout << name << " - " << (passed ? "PASSED" : "FAILED") << std::endl;
+}
+
+// Random keys, a quarter of them one of five small ones so that equal keys
+// show whether a sort is stable.
+template<typename Key>
+Key random_key(std::mt19937_64 & random) {
+  auto bits = random();
+  return Key(random() % 4 == 0 ? bits % 5 : bits);
+}
+template<>
+float random_key<float>(std::mt19937_64 & random) {
+  auto bits = random();
+  return float(int32_t(random() % 4 == 0 ? bits % 5 : bits % 20001) - 10000) / 8;
+}
+template<>
+double random_key<double>(std::mt19937_64 & random) {
+  auto bits = random();
+  return double(int64_t(random() % 4 == 0 ? bits % 5 : bits % 2000001) - 1000000) / 8;
+}
+
+// Sorts count random keys by sort(av, key, index), with values of value_words
+// words where word w of the value at i holds i * 8 + w. Keys and values have
+// to match a std::stable_sort.
+template<typename Key, typename Sort>
+bool sorts_stable(size_t count, uint32_t value_words, bool descending, Sort && sort) {
+  using namespace concurrency;
+  std::mt19937_64 random(count * 8 + value_words);
+  std::vector<Key> keys(count);
+  EACH(i, count) keys[i] = random_key<Key>(random);
+  std::vector<uint32_t> values(count * value_words);
+  EACH(i, values.size()) values[i] = uint32_t(i / value_words * 8 + i % value_words);
+  std::vector<size_t> order(count);
+  EACH(i, count) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&keys, descending](size_t a, size_t b) {
+    return descending ? keys[b] < keys[a] : keys[a] < keys[b];
+  });
+
+  std::vector<uint32_t> key_words(count * sizeof(Key) / sizeof(uint32_t));
+  memcpy(key_words.data(), keys.data(), count * sizeof(Key));
+  std::vector<uint32_t> sorted_values(values);
+  {
+    auto av = accelerator().default_view;
+    array_view<uint32_t> key(int(key_words.size()), key_words);
+    array_view<uint32_t> index(int(sorted_values.size()), sorted_values);
+    sort(av, key, index);
+    key.synchronize();
+    index.synchronize();
+  }
+  std::vector<Key> sorted(count);
+  memcpy(sorted.data(), key_words.data(), count * sizeof(Key));
+
+  auto passed = true;
+  for (size_t i = 0; i < count && passed; i++)
+    passed &= sorted[i] == keys[order[i]];
+  for (size_t i = 0; i < sorted_values.size() && passed; i++)
+    passed &= sorted_values[i] == values[order[i / value_words] * value_words + i % value_words];
+  return passed;
+}
+
+// Digits of 4, 8 and 11 bits sort in 8, 4 and 3 passes, the odd count of them
+// leaving the keys in the scratch to copy back.
+bool test_digit_widths() {
+  using namespace parallel::amp;
+  using namespace concurrency;
+  auto passed = true;
+  for (uint32_t bits : { 4, 8, 11 })
+    for (auto descending : { false, true })
+      passed &= sorts_stable<uint32_t>(100000, 1, descending,
+      [bits, descending](accelerator_view & av, array_view<uint32_t> key, array_view<uint32_t> index) {
+        radix_sort(av, key, index, descending, false, false, bits);
+      });
+  return passed;
+}
+
+// Signed and float keys of 32 and 64 bits, the 64-bit ones (low, high) word
+// pairs, sort as int32_t, float, uint64_t, int64_t and double.
+bool test_key_types() {
+  using namespace parallel::amp;
+  using namespace concurrency;
+  auto passed = true;
+  for (auto descending : { false, true }) {
+    auto sort = [descending](bool is_signed, bool is_float, bool is_64bit) {
+      return [=](accelerator_view & av, array_view<uint32_t> key, array_view<uint32_t> index) {
+        radix_sort(av, key, index, descending, is_signed, is_float, 8, is_64bit);
+      };
+    };
+    passed &= sorts_stable<int32_t>(100000, 1, descending, sort(true, false, false));
+    passed &= sorts_stable<float>(100000, 1, descending, sort(false, true, false));
+    passed &= sorts_stable<uint64_t>(100000, 1, descending, sort(false, false, true));
+    passed &= sorts_stable<int64_t>(100000, 1, descending, sort(true, false, true));
+    passed &= sorts_stable<double>(100000, 1, descending, sort(false, true, true));
+  }
+  return passed;
+}
+
+// Values of up to 8 words move along with their keys, whole and in order,
+// and wider ones are refused.
+bool test_wide_values() {
+  using namespace parallel::amp;
+  using namespace concurrency;
+  auto passed = true;
+  for (uint32_t words : { 2, 3, 8 })
+    for (size_t count : { 5000, 100000 }) {
+      passed &= sorts_stable<int32_t>(count, words, false,
+      [words](accelerator_view & av, array_view<uint32_t> key, array_view<uint32_t> index) {
+        radix_sort(av, key, index, false, true, false, 8, false, words);
+      });
+      passed &= sorts_stable<double>(count, words, true,
+      [words](accelerator_view & av, array_view<uint32_t> key, array_view<uint32_t> index) {
+        radix_sort(av, key, index, true, false, true, 8, true, words);
+      });
+    }
+  auto refused = false;
+  sorts_stable<uint32_t>(1000, 9, false,
+  [&refused](accelerator_view & av, array_view<uint32_t> key, array_view<uint32_t> index) {
+    try {
+      radix_sort(av, key, index, false, false, false, 8, false, 9);
+    } catch (runtime_exception const &) {
+      refused = true;
+    }
+  });
+  return passed && refused;
+}
+
+// Blocks rank every digit width a few bits at a time, widths that are not a
+// multiple of those bits in a narrower last round, and keep equal keys stable.
+bool test_block_ranking() {
+  using namespace parallel::amp;
+  using namespace concurrency;
+  auto passed = true;
+  for (uint32_t bits = 1; bits <= 11; bits++)
+    passed &= sorts_stable<uint32_t>(5000, 1, bits % 2 != 0,
+    [bits](accelerator_view & av, array_view<uint32_t> key, array_view<uint32_t> index) {
+      radix_sort(av, key, index, bits % 2 != 0, false, false, bits);
+    });
+  return passed;
+}
+
+// Grids of a single tile, of a tile more than one, of more tiles than the
+// threads of a tile scanning their histogram, and of the most tiles with more
+// blocks each than the fewest, sort alike.
+bool test_grid_sizes() {
+  using namespace parallel::amp;
+  using namespace concurrency;
+  auto passed = true;
+  for (size_t count : { 1, 1023, 8192, 8193, 300001, 2097153, 8388609 })
+    passed &= sorts_stable<int32_t>(count, 1, false,
+    [](accelerator_view & av, array_view<uint32_t> key, array_view<uint32_t> index) {
+      radix_sort(av, key, index, false, true);
+    });
+  return passed;
+}
+
 void test_amp(size_t min_count, size_t max_count, bool debug) {
   using namespace parallel::amp;
   using namespace concurrency;
@@ -36,6 +195,12 @@ void test_amp(size_t min_count, size_t max_count, bool debug) {
   auto cpu_acc = accelerator(accelerator::cpu_accelerator);
   std::wcout << L"C++ AMP"      << std::endl
     << L"\t" << acc.description << std::endl;
+
+  report("digit widths", test_digit_widths());
+  report("key types", test_key_types());
+  report("wide values", test_wide_values());
+  report("block ranking", test_block_ranking());
+  report("grid sizes", test_grid_sizes());
   array<uint32_t> keys(max_count, cpu_acc.default_view, acc.default_view);
   array<uint32_t> indexes(max_count, cpu_acc.default_view, acc.default_view);
   if (!debug) {
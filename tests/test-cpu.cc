@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cinttypes>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <parallel/cpu/primitives/radix-sort.hh>
+
+#define EACH(i, size) for (auto i = decltype(size)(0); i < size; i++)
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN 1
+#include <windows.h>
+uint64_t ticks(void) {
+  const uint64_t ticks_per_second = UINT64_C(10000000);
+  static LARGE_INTEGER freq;
+  static uint64_t start_time;
+  LARGE_INTEGER value;
+  QueryPerformanceCounter(&value);
+  if (!freq.QuadPart) {
+    QueryPerformanceFrequency(&freq);
+    start_time = value.QuadPart;
+  }
+  return ((value.QuadPart - start_time) * ticks_per_second) / freq.QuadPart;
+}
+#else
+#include <chrono>
+uint64_t ticks(void) {
+  using ticks_t = std::chrono::duration<uint64_t, std::ratio<1, 10000000>>;
+  static auto start_time = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<ticks_t>(std::chrono::steady_clock::now() - start_time).count();
+}
+#endif
+
+template<typename F>
+uint64_t timed(F && f) {
+  auto start = ticks();
+  f();
+  return ticks() - start;
+};
+
+// Orders key bits as uint32_t, int32_t or float.
+bool key_less(uint32_t a, uint32_t b, bool is_signed, bool is_float) {
+  if (is_float) {
+    float x, y;
+    memcpy(&x, &a, sizeof(x));
+    memcpy(&y, &b, sizeof(y));
+    return x < y;
+  }
+  return is_signed ? int32_t(a) < int32_t(b) : a < b;
+}
+
+// Sorts random keys, a quarter of them one of five small ones, with their
+// positions as values. The keys have to match a std::stable_sort of them, and
+// so have the values of the stable radix_sort, while radix_sort_in_place only
+// has to leave every position once next to a key equal to the one it had.
+bool sorts_like_stable_sort(parallel::cpu::thread_pool & pool, size_t count, bool descending,
+  bool is_signed, bool is_float, bool in_place) {
+  using namespace parallel::cpu;
+  std::mt19937 random(uint32_t(count * 8 + descending * 4 + is_signed * 2 + is_float));
+  std::vector<uint32_t> keys(count);
+  std::vector<uint32_t> indexes(count);
+  EACH(i, count) {
+    auto bits = uint32_t(random());
+    if (random() % 4 == 0) bits %= 5;
+    if (is_float) {
+      auto value = float(int32_t(bits % 20001) - 10000) / 8;
+      memcpy(&bits, &value, sizeof(bits));
+    }
+    keys[i] = bits;
+    indexes[i] = uint32_t(i);
+  }
+  std::vector<uint32_t> order(indexes);
+  std::stable_sort(order.begin(), order.end(), [&keys, descending, is_signed, is_float](uint32_t a, uint32_t b) {
+    return descending ? key_less(keys[b], keys[a], is_signed, is_float) : key_less(keys[a], keys[b], is_signed, is_float);
+  });
+  auto sorted = keys;
+  (in_place ? radix_sort_in_place : radix_sort)(pool, sorted.data(), count, indexes.data(), descending, is_signed, is_float);
+
+  std::vector<bool> seen(count);
+  EACH(i, count) {
+    if (sorted[i] != keys[order[i]]) return false;
+    if (!in_place && indexes[i] != order[i]) return false;
+    if (indexes[i] >= count || seen[indexes[i]] || keys[indexes[i]] != sorted[i]) return false;
+    seen[indexes[i]] = true;
+  }
+  return true;
+}
+
+// Duplicate heavy keys of every kind in both orders, over the sizes sorted by
+// insertion sort, by a single thread and by tasks across the pool.
+void test_cpu_orders(bool in_place) {
+  using namespace parallel::cpu;
+  auto & pool = thread_pool::instance();
+  auto passed = true;
+  for (size_t count : { 0, 1, 31, 1000, 100000, 1 << 20 })
+    for (auto descending : { false, true })
+      for (auto is_signed : { false, true })
+        for (auto is_float : { false, true })
+          if (!(is_signed && is_float))
+            passed &= sorts_like_stable_sort(pool, count, descending, is_signed, is_float, in_place);
+  std::cout << (in_place ? "CPU IN PLACE" : "CPU") << " orders - " << (passed ? "PASSED" : "FAILED") << std::endl;
+}
+
+// Threads sorting on one pool at once take it one after another.
+void test_cpu_threads(bool in_place) {
+  using namespace parallel::cpu;
+  thread_pool pool(4);
+  std::vector<char> passed(4);
+  std::vector<std::thread> threads;
+  EACH(t, passed.size())
+    threads.emplace_back([&pool, &passed, t, in_place] {
+      passed[t] = sorts_like_stable_sort(pool, 100000 + t, t % 2 != 0, t % 4 == 2, false, in_place);
+    });
+  for (auto & thread : threads) thread.join();
+  auto all_passed = std::find(passed.begin(), passed.end(), 0) == passed.end();
+  std::cout << (in_place ? "CPU IN PLACE" : "CPU") << " threads - " << (all_passed ? "PASSED" : "FAILED") << std::endl;
+}
+
+void test_cpu(size_t min_count, size_t max_count, bool debug, bool in_place) {
+  using namespace parallel::cpu;
+  auto & pool = thread_pool::instance();
+  auto sort = in_place ? radix_sort_in_place : radix_sort;
+  std::cout << (in_place ? "CPU IN PLACE" : "CPU") << std::endl
+    << "\t" << pool.size() << " threads" << std::endl;
+  std::vector<uint32_t> keys(max_count);
+  std::vector<uint32_t> indexes(max_count);
+  if (!debug) {
+    std::cout << "Warming...";
+    sort(pool, keys.data(), min_count, indexes.data(), true, false, false);
+    std::cout << "done." << std::endl;
+  }
+  for (size_t count = min_count; count <= max_count; count <<= 1) {
+    EACH(i, count) {
+      size_t j = i == 0 ? 0 : rand() % i;
+      keys[i] = keys[j];
+      keys[j] = uint32_t(int32_t(i - count / 2));
+      indexes[i] = indexes[j];
+      indexes[j] = uint32_t(i);
+    }
+    auto elapsed = timed([&pool, &sort, &keys, &indexes, &count] {
+      sort(pool, keys.data(), count, indexes.data(), true, true, false);
+    });
+    auto passed = true;
+    for (size_t i = 0; i < count && passed; i++)
+      passed &= indexes[i] == count - i - 1;
+    std::cout       << std::setprecision(8) << std::setfill(' ')
+      << "count "   << std::setw(10)        << count << " "
+      << "elapsed " << std::setw(10)        << elapsed << " ticks " << std::setw(10) << elapsed / 10000000. << " sec "
+      << "speed "   << std::setw(12)        << (count * 10000000ll) / (elapsed + 1)                         << " per sec "
+      << "- "       << (passed ? "PASSED" : "FAILED")                                                       << std::endl;
+  }
+  std::cout << (in_place ? "COMPLETE CPU IN PLACE" : "COMPLETE CPU") << std::endl;
+}
+
+int main(int argc, char const * argv[]) {
+#ifndef NDEBUG
+  bool debug = true;
+#else
+  bool debug = argc > 2;
+#endif
+  size_t min_count = 1024;
+  size_t max_count = 64 * 1024 * 1024;
+  if (argc > 1) {
+    uint64_t count;
+    std::istringstream(argv[1]) >> count;
+    if (count < min_count) max_count = min_count;
+    if (count > UINT_MAX) max_count = UINT_MAX;
+    min_count = max_count = static_cast<size_t>(count);
+  }
+  srand(max_count);
+  test_cpu_orders(false);
+  test_cpu_orders(true);
+  test_cpu_threads(false);
+  test_cpu_threads(true);
+  test_cpu(min_count, max_count, debug, false);
+  test_cpu(min_count, max_count, debug, true);
+  std::cout << "Press [ENTER] for exit...";
+  std::cin.ignore();
+  return 0;
+}
@@ -1,15 +1,23 @@
+#include <algorithm>
 #include <cstdlib>
 #include <cstdint>
 #include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <random>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 #include <parallel/gl/opengl.hh>
 #include <parallel/gl/primitives/radix-sort.hh>
 
 #define EACH(i, size) for (auto i = decltype(size)(0); i < size; i++)
 
+#if defined(_WIN32)
 uint64_t ticks(void) {
   const uint64_t ticks_per_second = UINT64_C(10000000);
   static LARGE_INTEGER freq;
@@ -22,6 +30,14 @@ uint64_t ticks(void) {
   }
   return ((value.QuadPart - start_time) * ticks_per_second) / freq.QuadPart;
 }
+#else
+#include <chrono>
+uint64_t ticks(void) {
+  using ticks_t = std::chrono::duration<uint64_t, std::ratio<1, 10000000>>;
+  static auto start_time = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<ticks_t>(std::chrono::steady_clock::now() - start_time).count();
+}
+#endif
 
 template<typename F>
 uint64_t timed(F && f) {
@@ -33,12 +49,12 @@ uint64_t timed(F && f) {
 void APIENTRY debug_message(
   GLenum source, GLenum type, GLuint id, GLenum severity,
   GLsizei, GLchar const * message, void const *) {
-  std::cout    << std::resetiosflags << std::hex << std::setfill('0')
+  std::cout    << std::resetiosflags(std::ios::basefield) << std::hex << std::setfill('0')
     << "0x"    << std::setw(8)       << source   << ":"
     << "0x"    << std::setw(8)       << type     << ":"
     << "0x"    << std::setw(8)       << id       << ":"
     << "0x"    << std::setw(8)       << severity << std::endl
-    << message << std::endl;
+    << message << std::dec << std::endl;
   if (type == GL_DEBUG_TYPE_ERROR) {
     std::cout << "Press [ENTER] to exit...";
     std::cin.ignore();
@@ -46,26 +62,671 @@ void APIENTRY debug_message(
   }
 }
 
+void report(char const * name, bool passed) {
+  std::cout << name << " - " << (passed ? "PASSED" : "FAILED") << std::endl;
+}
+
+// Random keys, a quarter of them one of five small ones so that equal keys
+// show whether a sort is stable.
+template<typename Key>
+Key random_key(std::mt19937_64 & random) {
+  auto bits = random();
+  return Key(random() % 4 == 0 ? bits % 5 : bits);
+}
+template<>
+float random_key<float>(std::mt19937_64 & random) {
+  auto bits = random();
+  return float(int32_t(random() % 4 == 0 ? bits % 5 : bits % 20001) - 10000) / 8;
+}
+template<>
+double random_key<double>(std::mt19937_64 & random) {
+  auto bits = random();
+  return double(int64_t(random() % 4 == 0 ? bits % 5 : bits % 2000001) - 1000000) / 8;
+}
+
+// Sorts keys by sort(gl, key, index), with values of value_words words where
+// word w of the value at i holds i * 8 + w, none for 0. Keys and values have
+// to match a std::stable_sort of every range [ranges[r], ranges[r + 1]) and
+// keys from sorted on have to be left as they were.
+template<typename Key, typename Sort>
+bool sorts_stable(parallel::gl::GL const & gl, std::vector<Key> const & keys, GLuint value_words, bool descending,
+  Sort && sort, std::vector<size_t> ranges = std::vector<size_t>(), size_t sorted = SIZE_MAX) {
+  using namespace parallel::gl;
+  auto count = keys.size();
+  std::vector<GLuint> values(count * value_words);
+  EACH(i, values.size()) values[i] = GLuint(i / value_words * 8 + i % value_words);
+
+  sorted = std::min(sorted, count);
+  if (ranges.empty()) ranges = { 0, sorted };
+  std::vector<size_t> order(count);
+  EACH(i, count) order[i] = i;
+  EACH(r, ranges.size() - 1)
+    std::stable_sort(order.begin() + ranges[r], order.begin() + ranges[r + 1], [&keys, descending](size_t a, size_t b) {
+      return descending ? keys[b] < keys[a] : keys[a] < keys[b];
+    });
+
+  buffer buffers[2] = { buffer::empty(), buffer::empty() };
+  buffer::factory(gl, 2, buffers);
+  buffers[0].allocate<GL_DYNAMIC_COPY>(gl, sizeof(Key) * std::max<size_t>(count, 1), keys.data());
+  if (value_words != 0)
+    buffers[1].allocate<GL_DYNAMIC_COPY>(gl, sizeof(GLuint) * std::max<size_t>(values.size(), 1), values.data());
+  sort(gl, buffers[0], value_words != 0 ? buffers[1] : buffer::empty());
+
+  auto passed = true;
+  if (count != 0) {
+    buffers[0].map<GL_COPY_READ_BUFFER, GL_MAP_READ_BIT, Key>(gl, 0, count,
+    [&passed, &keys, &order](GL const &, Key * ptr, GLsizeiptr count) {
+      EACH(i, count)
+        if (!(passed &= ptr[i] == keys[order[i]])) break;
+    });
+  }
+  if (count != 0 && value_words != 0) {
+    buffers[1].map<GL_COPY_READ_BUFFER, GL_MAP_READ_BIT, GLuint>(gl, 0, values.size(),
+    [&passed, &values, &order, value_words](GL const &, GLuint * ptr, GLsizeiptr count) {
+      EACH(i, count)
+        if (!(passed &= ptr[i] == values[order[i / value_words] * value_words + i % value_words])) break;
+    });
+  }
+  buffer::destroy(gl, 2, buffers);
+  return passed;
+}
+
+// The same for count random keys.
+template<typename Key, typename Sort>
+bool sorts_stable(parallel::gl::GL const & gl, size_t count, GLuint value_words, bool descending, Sort && sort,
+  std::vector<size_t> ranges = std::vector<size_t>(), size_t sorted = SIZE_MAX) {
+  std::mt19937_64 random(count * 8 + value_words);
+  std::vector<Key> keys(count);
+  EACH(i, count) keys[i] = random_key<Key>(random);
+  return sorts_stable(gl, keys, value_words, descending, sort, ranges, sorted);
+}
+
+// Onesweep ranks tiles of keys, each after the tiles before it published their
+// digit counts, over more keys than a single work group sorts.
+bool test_onesweep(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  for (size_t count : { 8193, 100000, 300001 })
+    for (auto descending : { false, true })
+      passed &= sorts_stable<int32_t>(gl, count, 1, descending,
+      [count, descending](GL const & gl, buffer key, buffer index) {
+        radix_sort(gl, key, count, index, descending, true, false, 8, true);
+      });
+  for (GLuint bits : { 4, 6 })
+    passed &= sorts_stable<uint32_t>(gl, 100000, 0, false,
+    [bits](GL const & gl, buffer key, buffer index) {
+      radix_sort(gl, key, 100000, index, false, false, false, bits, true);
+    });
+  return passed;
+}
+
+// 64-bit keys are (low, high) word pairs ordered as uint64_t, int64_t or double.
+bool test_64bit_keys(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  for (auto descending : { false, true })
+    for (auto onesweep : { false, true }) {
+      passed &= sorts_stable<uint64_t>(gl, 100000, 1, descending,
+      [descending, onesweep](GL const & gl, buffer key, buffer index) {
+        radix_sort(gl, key, 100000, index, descending, false, false, 8, onesweep, true);
+      });
+      passed &= sorts_stable<int64_t>(gl, 100000, 1, descending,
+      [descending, onesweep](GL const & gl, buffer key, buffer index) {
+        radix_sort(gl, key, 100000, index, descending, true, false, 8, onesweep, true);
+      });
+      passed &= sorts_stable<double>(gl, 100000, 1, descending,
+      [descending, onesweep](GL const & gl, buffer key, buffer index) {
+        radix_sort(gl, key, 100000, index, descending, false, true, 8, onesweep, true);
+      });
+    }
+  passed &= sorts_stable<int64_t>(gl, 5000, 1, false, [](GL const & gl, buffer key, buffer index) {
+    radix_sort(gl, key, 5000, index, false, true, false, 8, false, true);
+  });
+  return passed;
+}
+
+// Values of up to 8 words move along with their keys, whole and in order.
+bool test_wide_values(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  for (GLuint words : { 2, 3, 8 })
+    for (size_t count : { 5000, 100000 }) {
+      passed &= sorts_stable<int32_t>(gl, count, words, false,
+      [count, words](GL const & gl, buffer key, buffer index) {
+        radix_sort(gl, key, count, index, false, true, false, 8, false, false, words);
+      });
+      passed &= sorts_stable<double>(gl, count, words, true,
+      [count, words](GL const & gl, buffer key, buffer index) {
+        radix_sort(gl, key, count, index, true, false, true, 8, true, true, words);
+      });
+    }
+  return passed;
+}
+
+// Segments of every tier, in local memory, by a work group each and like a
+// whole sort, and empty ones among them, sort each on its own.
+bool test_segments(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  std::vector<size_t> lengths[] = {
+    { 0, 1, 5, 0, 300, 512, 513, 4000, 16384, 16385, 0, 40000, 2, 0 },
+    { 0, 0, 0 },
+  };
+  for (auto const & segments : lengths) {
+    std::vector<size_t> ranges = { 0 };
+    for (auto length : segments) ranges.push_back(ranges.back() + length);
+    std::vector<GLuint> offsets(ranges.begin(), ranges.end());
+    auto count = ranges.back();
+    for (auto is_64bit : { false, true }) {
+      auto sort = [&offsets, count, is_64bit](GL const & gl, buffer key, buffer index) {
+        buffer offsets_buffer = buffer::empty();
+        buffer::factory(gl, 1, &offsets_buffer);
+        offsets_buffer.allocate<GL_DYNAMIC_COPY>(gl, sizeof(GLuint) * offsets.size(), offsets.data());
+        radix_sort_segments(gl, key, count, offsets_buffer, offsets.size() - 1, index,
+          is_64bit, true, false, 8, is_64bit, 1);
+        buffer::destroy(gl, 1, &offsets_buffer);
+      };
+      passed &= is_64bit
+        ? sorts_stable<int64_t>(gl, count, 1, true, sort, ranges)
+        : sorts_stable<int32_t>(gl, count, 1, false, sort, ranges);
+    }
+  }
+  return passed;
+}
+
+// Arrays of a batch sort each on its own, whole work groups of them or not.
+bool test_batch(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  for (size_t array_size : { 1, 100, 1024 })
+    for (auto descending : { false, true }) {
+      size_t arrays = 67;
+      std::vector<size_t> ranges;
+      EACH(i, arrays + 1) ranges.push_back(i * array_size);
+      passed &= sorts_stable<float>(gl, array_size * arrays, 1, descending,
+      [array_size, arrays, descending](GL const & gl, buffer key, buffer index) {
+        radix_sort_batch(gl, key, array_size, arrays, index, descending, false, true);
+      }, ranges);
+      passed &= sorts_stable<uint64_t>(gl, array_size * arrays, 0, descending,
+      [array_size, arrays, descending](GL const & gl, buffer key, buffer index) {
+        radix_sort_batch(gl, key, array_size, arrays, index, descending, false, false, true, 1);
+      }, ranges);
+    }
+  return passed;
+}
+
+// The typed sorts take the key flags from Key, the value width from Value
+// and the order from Order, for the free functions and radix_sorter alike.
+struct test_value { GLuint words[3]; };
+
+bool test_typed(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  passed &= sorts_stable<float>(gl, 100000, 3, true, [](GL const & gl, buffer key, buffer index) {
+    radix_sort<float, test_value, order::descending>(gl, key, 100000, index);
+  });
+  passed &= sorts_stable<int32_t>(gl, 5000, 0, false, [](GL const & gl, buffer key, buffer index) {
+    radix_sort<int32_t>(gl, key, 5000, index);
+  });
+  passed &= sorts_stable<uint32_t>(gl, 100000, 1, true, [](GL const & gl, buffer key, buffer index) {
+    radix_sort<uint32_t, GLuint, order::descending>(gl, key, 100000, index, 4, true);
+  });
+  radix_sorter sorter;
+  passed &= sorts_stable<int64_t>(gl, 100000, 2, false, [&sorter](GL const & gl, buffer key, buffer index) {
+    sorter.sort<int64_t, uint64_t>(gl, key, 100000, index);
+  });
+  passed &= sorts_stable<double>(gl, 100000, 0, true, [&sorter](GL const & gl, buffer key, buffer index) {
+    sorter.sort<double, void, order::descending>(gl, key, 100000, index, 8, true);
+  });
+  sorter.trim(gl);
+  return passed;
+}
+
+// A sort of the count held in a buffer sorts that many keys and leaves the
+// keys and values past it up to capacity as they were.
+bool test_count_buffer(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  size_t const capacity = 100000;
+  for (GLuint count : { 0, 1, 5000, 70001, 100000 })
+    for (auto onesweep : { false, true }) {
+      auto sort = [count, onesweep](GL const & gl, buffer key, buffer index) {
+        GLuint counts[] = { 0, count };
+        buffer count_buffer = buffer::empty();
+        buffer::factory(gl, 1, &count_buffer);
+        count_buffer.allocate<GL_DYNAMIC_COPY>(gl, sizeof(counts), counts);
+        radix_sort(gl, key, count_buffer, sizeof(GLuint), capacity, index, false, true, false, 8, onesweep);
+        buffer::destroy(gl, 1, &count_buffer);
+      };
+      passed &= sorts_stable<int32_t>(gl, capacity, 1, false, sort, std::vector<size_t>(), count);
+    }
+  return passed;
+}
+
+// Keys already in order, in strictly reverse order and in reverse order with
+// equal ones among them sort in both orders, on either side of the largest
+// count a single work group sorts.
+bool test_arranged(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  for (size_t count : { 8192, 8193, 100000 })
+    for (auto descending : { false, true })
+      for (auto onesweep : { false, true }) {
+        auto sort = [count, descending, onesweep](GL const & gl, buffer key, buffer index) {
+          radix_sort(gl, key, count, index, descending, true, false, 8, onesweep);
+        };
+        auto in_order = [descending](int32_t a, int32_t b) { return descending ? b < a : a < b; };
+        std::mt19937_64 random(count);
+        std::vector<int32_t> keys(count);
+        EACH(i, count) keys[i] = random_key<int32_t>(random);
+        std::sort(keys.begin(), keys.end(), in_order);
+        passed &= sorts_stable(gl, keys, 1, descending, sort);
+        std::reverse(keys.begin(), keys.end());
+        passed &= sorts_stable(gl, keys, 1, descending, sort);
+        EACH(i, count) keys[i] = (int32_t(i) - int32_t(count / 2)) * (descending ? 1 : -1);
+        passed &= sorts_stable(gl, keys, 1, descending, sort);
+        passed &= sorts_stable(gl, keys, 0, descending, sort);
+      }
+  return passed;
+}
+
+// Keys with the same digit in every pass but one, or in all of them, sort
+// with the passes of constant digits skipped, for 32-bit and 64-bit keys.
+bool test_constant_digits(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  size_t const count = 100000;
+  std::mt19937_64 random(count);
+  for (auto onesweep : { false, true })
+    for (auto descending : { false, true }) {
+      std::vector<uint32_t> keys(count, 0x12345678u);
+      passed &= sorts_stable(gl, keys, 1, descending, [descending, onesweep](GL const & gl, buffer key, buffer index) {
+        radix_sort(gl, key, count, index, descending, false, false, 8, onesweep);
+      });
+      for (auto shift : { 0, 16, 24 }) {
+        EACH(i, count) keys[i] = (0x12345678u & ~(0xffu << shift)) | uint32_t(random() % 256) << shift;
+        passed &= sorts_stable(gl, keys, 1, descending, [descending, onesweep](GL const & gl, buffer key, buffer index) {
+          radix_sort(gl, key, count, index, descending, false, false, 8, onesweep);
+        });
+      }
+      std::vector<uint64_t> wide_keys(count);
+      EACH(i, count) wide_keys[i] = (0x0123456789abcdefull & ~(0xffull << 40)) | (random() % 256) << 40;
+      passed &= sorts_stable(gl, wide_keys, 1, descending, [descending, onesweep](GL const & gl, buffer key, buffer index) {
+        radix_sort(gl, key, count, index, descending, false, false, 8, onesweep, true);
+      });
+    }
+  return passed;
+}
+
+void APIENTRY count_errors(
+  GLenum, GLenum type, GLuint, GLenum,
+  GLsizei, GLchar const *, void const * errors) {
+  if (type == GL_DEBUG_TYPE_ERROR) ++*static_cast<int *>(const_cast<void *>(errors));
+}
+
+// A sorter sorts in an attached scratch buffer and reports one too small for
+// a sort instead of reallocating it, leaving the keys as they were. trim()
+// detaches a caller's scratch and frees only one of the sorter's own.
+bool test_attach(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  size_t const count = 100000;
+  auto size = radix_sorter::scratch_size(gl, count);
+  buffer scratch = buffer::empty();
+  buffer::factory(gl, 1, &scratch);
+  scratch.allocate<GL_DYNAMIC_COPY>(gl, size);
+
+  radix_sorter sorter;
+  sorter.attach(scratch, size);
+  passed &= sorts_stable<int32_t>(gl, count, 1, false, [&sorter](GL const & gl, buffer key, buffer index) {
+    sorter.sort(gl, key, count, index, false, true);
+  });
+  passed &= sorter.scratch.id == scratch.id && sorter.capacity == size;
+
+  auto errors = 0;
+  auto debug_output = glIsEnabled(GL_DEBUG_OUTPUT);
+  glEnable(GL_DEBUG_OUTPUT);
+  gl.DebugMessageCallback(count_errors, &errors);
+  passed &= sorts_stable<int32_t>(gl, count * 2, 1, false, [&sorter](GL const & gl, buffer key, buffer index) {
+    sorter.sort(gl, key, count * 2, index, false, true);
+  }, std::vector<size_t>(), 0);
+  gl.DebugMessageCallback(debug_message, nullptr);
+  if (!debug_output) glDisable(GL_DEBUG_OUTPUT);
+  passed &= errors == 1 && sorter.scratch.id == scratch.id && sorter.capacity == size;
+
+  sorter.trim(gl);
+  passed &= !sorter.attached && sorter.scratch.is_empty() && sorter.capacity == 0;
+  passed &= buffer { scratch.id }.size(gl) == size;
+  buffer::destroy(gl, 1, &scratch);
+
+  passed &= sorts_stable<int32_t>(gl, count * 2, 1, false, [&sorter](GL const & gl, buffer key, buffer index) {
+    sorter.sort(gl, key, count * 2, index, false, true);
+  });
+  passed &= !sorter.scratch.is_empty() && sorter.capacity >= radix_sorter::scratch_size(gl, count * 2);
+  sorter.trim(gl);
+  passed &= sorter.capacity == 0 && sorter.scratch.size(gl) == 0;
+  buffer::destroy(gl, 1, &sorter.scratch);
+  return passed;
+}
+
+// Sorts of the variants warmed up run the kernels built ahead of them, while
+// a config of a value size not supported is reported and the others of the
+// same warm-up still built, and a variant not warmed up builds its own.
+bool test_warm_up(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  radix_sort_engine engine;
+  auto errors = 0;
+  auto debug_output = glIsEnabled(GL_DEBUG_OUTPUT);
+  glEnable(GL_DEBUG_OUTPUT);
+  gl.DebugMessageCallback(count_errors, &errors);
+  engine.warm_up(gl, {
+    radix_config::of<double, test_value, order::descending>(8, true),
+    radix_config { 8, false, false, false, false, false, 9 },
+    radix_config::of<int32_t>(4),
+  });
+  gl.DebugMessageCallback(debug_message, nullptr);
+  if (!debug_output) glDisable(GL_DEBUG_OUTPUT);
+  passed &= errors == 1;
+
+  radix_sorter sorter(engine);
+  for (size_t count : { 5000, 100000 }) {
+    passed &= sorts_stable<double>(gl, count, 3, true, [&sorter, count](GL const & gl, buffer key, buffer index) {
+      sorter.sort<double, test_value, order::descending>(gl, key, count, index, 8, true);
+    });
+    passed &= sorts_stable<int32_t>(gl, count, 0, false, [&sorter, count](GL const & gl, buffer key, buffer index) {
+      sorter.sort<int32_t>(gl, key, count, index, 4);
+    });
+    passed &= sorts_stable<float>(gl, count, 1, false, [&sorter, count](GL const & gl, buffer key, buffer index) {
+      sorter.sort<float, GLuint>(gl, key, count, index);
+    });
+  }
+  sorter.trim(gl);
+  engine.release(gl);
+  return passed;
+}
+
+// The fence of an asynchronous sort calls its then() callback once, from the
+// ready() that first finds the keys sorted, and none after a release().
+bool test_fence(parallel::gl::GL const & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  for (size_t count : { 5000, 100000 }) {
+    auto calls = 0;
+    passed &= sorts_stable<int32_t>(gl, count, 1, false, [count, &calls, &passed](GL const & gl, buffer key, buffer index) {
+      auto sorted = radix_sort_async(gl, key, count, index, false, true);
+      sorted.then([&calls] { calls++; });
+      while (!sorted.ready(gl)) passed &= calls == 0;
+      passed &= calls == 1 && sorted.ready(gl) && sorted.wait(gl) && calls == 1;
+    });
+    passed &= calls == 1;
+  }
+  auto calls = 0;
+  passed &= sorts_stable<uint32_t>(gl, 100000, 0, false, [&calls](GL const & gl, buffer key, buffer) {
+    radix_sort_async(gl, key).then([&calls] { calls++; }).release(gl);
+    glFinish();
+  });
+  passed &= calls == 0;
+  return passed;
+}
+
+// A context of the share group of gl sorts on a thread of its own while gl
+// sorts too, with an engine sharing the kernels of the engine of gl and with
+// a sorter made on this thread that sorts on the engine of the other.
+bool test_share_group(parallel::gl::GL const & gl, bool debug) {
+  using namespace parallel::gl;
+  auto shared = radix_sort_engine::instance().share();
+  radix_sorter sorter;
+  auto shared_passed = false;
+  std::thread thread([&gl, debug, &shared, &sorter, &shared_passed] {
+    GL other;
+#if defined(PARALLEL_GL_EGL)
+    other.initialize(&debug_message, debug, &gl);
+#else
+    auto window = CreateWindowExA(WS_EX_APPWINDOW, "static", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    other.initialize(GetDC(window), &debug_message, debug, &gl);
+#endif
+    radix_sorter shared_sorter(shared);
+    auto passed = true;
+    for (auto onesweep : { false, true }) {
+      passed &= sorts_stable<int32_t>(other, 300001, 1, true, [&shared_sorter, onesweep](GL const & gl, buffer key, buffer index) {
+        shared_sorter.sort(gl, key, 300001, index, true, true, false, 8, onesweep);
+      });
+      passed &= sorts_stable<uint32_t>(other, 100000, 1, false, [&sorter, onesweep](GL const & gl, buffer key, buffer index) {
+        sorter.sort(gl, key, 100000, index, false, false, false, 8, onesweep);
+      });
+    }
+    sorter.trim(other);
+    shared_sorter.trim(other);
+    shared.release(other);
+    radix_sort_engine::instance().release(other);
+    other.deinitialize();
+#if !defined(PARALLEL_GL_EGL)
+    DestroyWindow(window);
+#endif
+    shared_passed = passed;
+  });
+  auto passed = true;
+  for (auto onesweep : { false, true })
+    passed &= sorts_stable<int32_t>(gl, 300001, 1, false, [onesweep](GL const & gl, buffer key, buffer index) {
+      radix_sort(gl, key, 300001, index, false, true, false, 8, onesweep);
+    });
+  thread.join();
+  return passed && shared_passed;
+}
+
+// Work groups sum their digit counts with the Blelloch scan and, on a device
+// with subgroup arithmetic, with the subgroup scan too, each built by an
+// engine of its own.
+bool test_subgroups(parallel::gl::GL & gl) {
+  using namespace parallel::gl;
+  auto passed = true;
+  auto subgroup_arithmetic = gl.subgroup_arithmetic;
+  for (auto subgroups : { false, true }) {
+    if (subgroups && !subgroup_arithmetic) continue;
+    gl.subgroup_arithmetic = subgroups;
+    radix_sort_engine engine;
+    radix_sorter sorter(engine);
+    for (size_t count : { 5000, 100000 })
+      for (auto onesweep : { false, true })
+        passed &= sorts_stable<int32_t>(gl, count, 1, false, [&sorter, count, onesweep](GL const & gl, buffer key, buffer index) {
+          sorter.sort(gl, key, count, index, false, true, false, 8, onesweep);
+        });
+    sorter.trim(gl);
+    engine.release(gl);
+  }
+  gl.subgroup_arithmetic = subgroup_arithmetic;
+  return passed;
+}
+
+// SPIR-V of the GLSL in test_spirv_modules with v = V + 1u instead of v = V,
+// so the value written tells which of them ran and that V was specialized.
+static uint32_t const store_next_module[] = {
+  0x07230203, 0x00010000, 0x00000000, 0x00000010, 0x00000000,
+  0x00020011, 0x00000001,                                     // OpCapability Shader
+  0x0003000e, 0x00000000, 0x00000001,                         // OpMemoryModel Logical GLSL450
+  0x0005000f, 0x00000005, 0x0000000b, 0x6e69616d, 0x00000000, // OpEntryPoint GLCompute %11 "main"
+  0x00060010, 0x0000000b, 0x00000011, 1, 1, 1,                // OpExecutionMode %11 LocalSize 1 1 1
+  0x00040047, 0x0000000a, 0x00000001, 0,                      // OpDecorate %10 SpecId 0
+  0x00030047, 0x00000004, 0x00000003,                         // OpDecorate %4 BufferBlock
+  0x00050048, 0x00000004, 0x00000000, 0x00000023, 0,          // OpMemberDecorate %4 0 Offset 0
+  0x00040047, 0x00000006, 0x00000021, 0,                      // OpDecorate %6 Binding 0
+  0x00020013, 0x00000001,                                     // %1 = OpTypeVoid
+  0x00030021, 0x00000002, 0x00000001,                         // %2 = OpTypeFunction %1
+  0x00040015, 0x00000003, 32, 0,                              // %3 = OpTypeInt 32 0
+  0x0003001e, 0x00000004, 0x00000003,                         // %4 = OpTypeStruct %3
+  0x00040020, 0x00000005, 0x00000002, 0x00000004,             // %5 = OpTypePointer Uniform %4
+  0x0004003b, 0x00000005, 0x00000006, 0x00000002,             // %6 = OpVariable %5 Uniform
+  0x00040015, 0x00000007, 32, 1,                              // %7 = OpTypeInt 32 1
+  0x0004002b, 0x00000007, 0x00000008, 0,                      // %8 = OpConstant %7 0
+  0x00040020, 0x00000009, 0x00000002, 0x00000003,             // %9 = OpTypePointer Uniform %3
+  0x00040032, 0x00000003, 0x0000000a, 0,                      // %10 = OpSpecConstant %3 0
+  0x0004002b, 0x00000003, 0x0000000e, 1,                      // %14 = OpConstant %3 1
+  0x00050036, 0x00000001, 0x0000000b, 0x00000000, 0x00000002, // %11 = OpFunction %1 None %2
+  0x000200f8, 0x0000000c,                                     // %12 = OpLabel
+  0x00050041, 0x00000009, 0x0000000d, 0x00000006, 0x00000008, // %13 = OpAccessChain %9 %6 %8
+  0x00050080, 0x00000003, 0x0000000f, 0x0000000a, 0x0000000e, // %15 = OpIAdd %3 %10 %14
+  0x0003003e, 0x0000000d, 0x0000000f,                         // OpStore %13 %15
+  0x000100fd,                                                 // OpReturn
+  0x00010038                                                  // OpFunctionEnd
+};
+
+// Without a module the GLSL runs with V defined, with one the module runs
+// specialized, given no constant it does not declare, and a file that is not
+// SPIR-V falls back to GLSL.
+bool test_spirv_modules(parallel::gl::GL & gl) {
+  using namespace parallel::gl;
+  GLchar const * body = GLSL(
+    layout(local_size_x = 1) in;
+    layout(std430, binding = 0) buffer B { uint v; };
+    CONSTANT(0, uint, V, 0u)
+    void main() { v = V; }
+  );
+  auto sources = program_sources(false, 1, &body);
+  GLuint const ids[] = { 0, 5 }, values[] = { 7, 3 };
+  specialization constants { 2, ids, values };
+  auto directory = gl.spirv_modules;
+  gl.spirv_modules = ".";
+  auto module = module_path(gl.spirv_modules, GL_COMPUTE_SHADER, GLsizei(sources.size()), sources.data());
+  auto write_module = [&module](void const * data, size_t size) {
+    if (auto file = fopen(module.c_str(), "wb")) {
+      fwrite(data, 1, size, file);
+      fclose(file);
+    }
+  };
+  buffer value = { 0 };
+  buffer::factory(gl, 1, &value);
+  value.allocate<GL_DYNAMIC_COPY>(gl, sizeof(GLuint));
+  auto run = [&gl, &sources, &constants, &value] {
+    GLuint result = 0;
+    value.sub_data(gl, result, 0);
+    auto id = create_program(gl, GL_COMPUTE_SHADER, GLsizei(sources.size()), sources.data(), constants);
+    gl.use_program(id);
+    value.bind<GL_SHADER_STORAGE_BUFFER>(gl, 0);
+    gl.DispatchCompute(1, 1, 1);
+    gl.MemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    gl.use_program(0);
+    gl.DeleteProgram(id);
+    value.map<GL_COPY_READ_BUFFER, GL_MAP_READ_BIT, GLuint>(gl, 0, 1,
+    [&result](GL const &, GLuint * ptr, GLsizeiptr) { result = *ptr; });
+    return result;
+  };
+
+  remove(module.c_str());
+  auto passed = run() == 7;
+  write_module(store_next_module, sizeof(store_next_module));
+  passed &= run() == (gl.SpecializeShader != nullptr ? 8u : 7u);
+  write_module(body, strlen(body));
+  passed &= run() == 7;
+
+  remove(module.c_str());
+  buffer::destroy(gl, 1, &value);
+  gl.spirv_modules = directory;
+  return passed;
+}
+
+// A program is linked and its binary stored in gl.program_cache by its first
+// check, a program of the same sources and constants is loaded from that
+// binary without a retrievable hint, and one of a damaged file linked again.
+bool test_program_cache(parallel::gl::GL & gl) {
+  using namespace parallel::gl;
+  GLchar const * body = GLSL(
+    layout(local_size_x = 1) in;
+    layout(std430, binding = 0) buffer B { uint v; };
+    CONSTANT(0, uint, V, 0u)
+    void main() { v = V; }
+  );
+  auto sources = program_sources(false, 1, &body);
+  GLuint const ids[] = { 0 }, values[] = { 7 };
+  specialization constants { 1, ids, values };
+  auto directory = gl.program_cache;
+  gl.program_cache = ".";
+  auto path = binary_path(gl, GL_COMPUTE_SHADER, GLsizei(sources.size()), sources.data(), constants);
+  auto stored = [&path] {
+    auto file = fopen(path.c_str(), "rb");
+    if (file != nullptr) fclose(file);
+    return file != nullptr;
+  };
+  buffer value = { 0 };
+  buffer::factory(gl, 1, &value);
+  value.allocate<GL_DYNAMIC_COPY>(gl, sizeof(GLuint));
+  auto run = [&gl, &sources, &constants, &value](GLint hint) {
+    GLuint result = 0;
+    value.sub_data(gl, result, 0);
+    auto id = create_program(gl, GL_COMPUTE_SHADER, GLsizei(sources.size()), sources.data(), constants);
+    check_program(gl, id);
+    auto retrievable = GL_FALSE;
+    gl.GetProgramiv(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, &retrievable);
+    gl.use_program(id);
+    value.bind<GL_SHADER_STORAGE_BUFFER>(gl, 0);
+    gl.DispatchCompute(1, 1, 1);
+    gl.MemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    gl.use_program(0);
+    gl.DeleteProgram(id);
+    value.map<GL_COPY_READ_BUFFER, GL_MAP_READ_BIT, GLuint>(gl, 0, 1,
+    [&result](GL const &, GLuint * ptr, GLsizeiptr) { result = *ptr; });
+    return result == 7 && retrievable == hint;
+  };
+
+  remove(path.c_str());
+  auto passed = run(GL_TRUE);
+  auto formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  if (formats > 0) {
+    passed &= stored() && run(GL_FALSE);
+    if (auto file = fopen(path.c_str(), "r+b")) {
+      fputs("damaged", file);
+      fclose(file);
+    }
+    passed &= run(GL_TRUE) && run(GL_FALSE);
+  }
+
+  remove(path.c_str());
+  buffer::destroy(gl, 1, &value);
+  gl.program_cache = directory;
+  return passed;
+}
+
 void test_gl(size_t min_count, size_t max_count, bool debug) {
   using namespace parallel::gl;
+#if defined(PARALLEL_GL_EGL)
+  auto & gl = GL::instance().initialize(&debug_message, debug);
+#else
   auto window = CreateWindowExA(WS_EX_APPWINDOW, "static", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
   auto device = GetDC(window);
   auto & gl = GL::instance().initialize(device, &debug_message, debug);
+#endif
 
   std::cout
     << "OpenGL " << glGetString(GL_VERSION)  << std::endl
     << "\t"      << glGetString(GL_VENDOR)   << std::endl
     << "\t"      << glGetString(GL_RENDERER) << std::endl;
 
+  report("spirv modules", test_spirv_modules(gl));
+  report("program cache", test_program_cache(gl));
+  report("onesweep", test_onesweep(gl));
+  report("64-bit keys", test_64bit_keys(gl));
+  report("wide values", test_wide_values(gl));
+  report("segments", test_segments(gl));
+  report("batch", test_batch(gl));
+  report("typed", test_typed(gl));
+  report("count buffer", test_count_buffer(gl));
+  report("arranged", test_arranged(gl));
+  report("constant digits", test_constant_digits(gl));
+  report("attach", test_attach(gl));
+  report("warm up", test_warm_up(gl));
+  report("fence", test_fence(gl));
+  report("share group", test_share_group(gl, debug));
+  report("subgroups", test_subgroups(gl));
+
   struct { buffer objects[2]; } buffers = { 0 };
-  buffer::factory(gl, sizeof(buffers) / sizeof(GLuint), buffers.objects);
+  buffer::factory(gl, sizeof(buffers) / sizeof(buffer), buffers.objects);
   buffers.objects[0].allocate<GL_DYNAMIC_COPY>(gl, sizeof(GLint) * max_count);
   buffers.objects[1].allocate<GL_DYNAMIC_COPY>(gl, sizeof(GLuint) * max_count);
   if (!debug) {
     std::cout << "Warming...";
-    radix_sort(gl, buffers.objects[0], min_count, buffers.objects[1], true, true);
-    glFinish();
-    std::cout << "done." << std::endl;
+    auto warmed = radix_sort_async(gl, buffers.objects[0], min_count, buffers.objects[1], true, true).wait(gl);
+    std::cout << (warmed ? "done." : "failed.") << std::endl;
   }
   for (size_t count = min_count; count <= max_count; count <<= 1) {
     buffers.objects[0].map<GL_COPY_WRITE_BUFFER, GL_MAP_WRITE_BIT, GLint>(gl, 0, count,
@@ -81,11 +742,10 @@ void test_gl(size_t min_count, size_t max_count, bool debug) {
         }
       });
     });
-    auto elapsed = timed([&gl, &buffers, &count] {
-      radix_sort(gl, buffers.objects[0], count, buffers.objects[1], true, true);
-      glFinish();
-    });
     auto passed = true;
+    auto elapsed = timed([&gl, &buffers, &count, &passed] {
+      passed = radix_sort_async(gl, buffers.objects[0], count, buffers.objects[1], true, true).wait(gl);
+    });
     buffers.objects[1].map<GL_COPY_READ_BUFFER,  GL_MAP_READ_BIT, GLuint>(gl, 0, count,
     [&passed](GL const &, GLuint * ptr, GLsizeiptr count) {
       EACH(i, count)
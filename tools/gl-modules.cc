@@ -0,0 +1,39 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <parallel/gl/opengl.hh>
+#include <parallel/gl/primitives/radix-sort.hh>
+
+// Builds the SPIR-V modules of the kernels into a directory for
+// GL::spirv_modules: the sources of each as <hash>.comp, compiled by
+// glslangValidator to <hash>.spv. The modules of a device with subgroup
+// arithmetic take SPIR-V 1.3 for its group operations.
+//
+//   parallel-gl-modules [directory] [glslangValidator]
+int main(int argc, char const * argv[]) {
+  using namespace parallel::gl;
+  auto directory = argc > 1 ? argv[1] : ".";
+  auto compiler = argc > 2 ? argv[2] : "glslangValidator";
+  auto failed = 0;
+  radix_sort_kernel_sources([&](bool subgroup_arithmetic, GLsizei count, GLchar const * const * sources) {
+    auto module = module_path(directory, GL_COMPUTE_SHADER, count, sources);
+    auto source = module.substr(0, module.size() - 3) + "comp";
+    auto file = fopen(source.c_str(), "wb");
+    if (file == nullptr) {
+      std::cerr << "cannot write " << source << std::endl;
+      failed++;
+      return;
+    }
+    for (GLsizei i = 0; i < count; i++) fwrite(sources[i], 1, strlen(sources[i]), file);
+    fclose(file);
+    auto command = std::string(compiler) + " -G"
+      + (subgroup_arithmetic ? " --target-env spirv1.3" : "")
+      + " -o \"" + module + "\" \"" + source + "\"";
+    if (system(command.c_str()) != 0) failed++;
+  });
+  if (failed != 0) std::cerr << failed << " modules failed" << std::endl;
+  return failed != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}